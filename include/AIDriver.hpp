@@ -0,0 +1,134 @@
+#pragma once
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "CarInput.hpp"
+#include "CollisionMap.hpp"
+
+#include <vector>
+#include <cmath>
+
+// driving policy of a computer car, gives the same inputs as the keyboard does in Car::input
+// follows a loop of waypoints and looks ahead with a few rays (whiskers) to steer away from walls
+// only reads the map, so every driver can decide on its own thread
+
+class AIDriver
+{
+private:
+    std::vector<Vector2> m_waypoints;
+    size_t m_target{0};
+    size_t m_passed{0};
+
+    const float m_reachRadius{160.f};
+    const float m_lookAhead{400.f};
+
+    static constexpr int whiskerCount = 5;
+    const float m_whiskerAngles[whiskerCount] = {-50.f, -25.f, 0.f, 25.f, 50.f};
+
+    // free distance along a ray up to m_lookAhead, steps as far as the distance field allows
+
+    template <typename Grid>
+    float probe(const Grid& map, Vector2 from, Vector2 direction) const
+    {
+        const float minStep = map.rectWidth() * 0.5f;
+        float distance = 0.f;
+
+        while (distance < m_lookAhead)
+        {
+            const Vector2 point = Vector2Add(from, Vector2Scale(direction, distance));
+            const auto index = map.getIndexWorldPos(point);
+            if (map.isSolid(index)) return distance;
+
+            float step = minStep;
+            if (map.hasDistanceField()) step = fmaxf(map.distanceToSolid(point) - map.rectWidth() * 1.5f, minStep);
+            distance += step;
+        }
+
+        return m_lookAhead;
+    }
+
+public:
+    // drives towards the waypoint after the one closest to startPos
+
+    AIDriver(std::vector<Vector2> waypoints, Vector2 startPos)
+        : m_waypoints(std::move(waypoints))
+    {
+        float closest = INFINITY;
+        for (size_t i = 0; i < m_waypoints.size(); ++i)
+        {
+            const float distance = Vector2Distance(startPos, m_waypoints[i]);
+            if (distance < closest)
+            {
+                closest = distance;
+                m_target = (i + 1) % m_waypoints.size();
+            }
+        }
+    }
+
+    // map is a Map::CollisionMap or a Map::ChunkedWorld
+
+    template <typename Grid>
+    CarInput decide(Vector2 pos, float rotation, Vector2 vel, const Grid& map)
+    {
+        CarInput input;
+        if (m_waypoints.empty()) return input;
+
+        // at most one lap, on small maps every waypoint can be in reach
+
+        for (size_t i = 0; i < m_waypoints.size() && Vector2Distance(pos, m_waypoints[m_target]) < m_reachRadius; ++i)
+        {
+            m_target = (m_target + 1) % m_waypoints.size();
+            ++m_passed;
+        }
+
+        const float rad = rotation * (PI / 180.f);
+        const Vector2 forward = {sinf(rad), -cosf(rad)};
+        const Vector2 toTarget = Vector2Normalize(Vector2Subtract(m_waypoints[m_target], pos));
+
+        // positive when the target is to the right, on screen y points down
+
+        const float cross = forward.x * toTarget.y - forward.y * toTarget.x;
+        const float alignment = Vector2DotProduct(forward, toTarget);
+
+        float free[whiskerCount];
+        for (int i = 0; i < whiskerCount; ++i)
+        {
+            const float whiskerRad = rad + m_whiskerAngles[i] * (PI / 180.f);
+            free[i] = probe(map, pos, {sinf(whiskerRad), -cosf(whiskerRad)});
+        }
+
+        // walls push the steering towards the side with more room
+
+        const float avoid = ((free[3] + free[4]) - (free[0] + free[1])) / (2.f * m_lookAhead);
+        const float steer = cross + avoid * (1.f - free[2] / m_lookAhead + 0.5f);
+
+        // with the target behind the car always turn to one side, without a dead zone it could drive away from it
+
+        if (alignment < 0.f)
+        {
+            input.right = steer >= 0.f;
+            input.left = !input.right;
+        }
+        else
+        {
+            input.right = steer > 0.05f;
+            input.left = steer < -0.05f;
+        }
+
+        const float speed = Vector2Length(vel);
+        const bool blocked = free[2] < speed * 0.5f;
+
+        input.forward = !blocked || speed < 100.f;
+        input.backward = blocked && speed > 300.f;
+        input.handBrake = alignment < 0.3f && speed > 250.f;
+        input.boost = alignment > 0.98f && free[2] >= m_lookAhead;
+
+        return input;
+    }
+
+    // waypoints reached since the start
+
+    size_t passed() const {return m_passed;}
+    size_t target() const {return m_target;}
+};
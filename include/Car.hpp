@@ -1,7 +1,16 @@
 #pragma once
 
 #include "Trail.hpp"
+#include "CarInput.hpp"
+#include "InputSource.hpp"
 #include "MapManager.hpp"
+#include "Collision.hpp"
+#include "ChunkedWorld.hpp"
+#include "SimStats.hpp"
+
+#include "imgui.h"
+
+#include <mutex>
 
 class Car
 {
@@ -37,13 +46,46 @@ private:
 
     Vector2 m_vel{0, 0};
     Vector2 m_pos{0, 0};
+
+    // state of the previous tick, to interpolate between ticks when rendering
+
+    Vector2 m_prevPos{0, 0};
+    float m_prevRotation{0};
+
     Vector2 m_size{0, 0};
     Vector2 m_rotationOffset;
 
     Rectangle m_carAABB{0, 0, 0, 0};
 
+    // solid cells under the car, reused every tick, on a collision map or a streamed world
+
+    std::vector<int> m_solidCells;
+    std::vector<int64_t> m_worldCells;
+
+    std::vector<int>& scratchCells(const Map::CollisionMap&) {return m_solidCells;}
+    std::vector<int64_t>& scratchCells(const Map::ChunkedWorld&) {return m_worldCells;}
+
+    // collision debug view, contacts are recorded by resolveCollision and drawn by render
+
+    bool m_collisionDebug{false};
+    std::vector<Rectangle> m_debugContacts;
+
+    const Collision::Response m_wallResponse{};
+
     Texture2D* m_texture{nullptr};
 
+    const Color m_trailColor{80, 80, 80, 150};
+
+    // cars can update on several threads, drift messages share one lock so lines dont mix
+
+    bool m_logDrifts{true};
+
+    static std::mutex& logMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
 public:     
     Car(
         float trailTime,
@@ -67,6 +109,7 @@ public:
         , m_handbrakeGrip(grip/4)
         , m_grip(grip)
         , m_pos(startPos)
+        , m_prevPos(startPos)
         , m_size(size)
         , m_rotationOffset({0.5f * size.x, 0.8f * size.y})
         , m_texture(texture)
@@ -74,29 +117,45 @@ public:
 
     ~Car() = default;
 
-    void input(const float dt)
+    // input of the next tick, from the keyboard, a script or a replay
+
+    void input(InputSource& source, const float dt)
+    {
+        applyInput(source.next(), dt);
+    }
+
+    // set throttle and steering from an input, without touching the keyboard (used headless)
+
+    void applyInput(const CarInput& input, const float dt)
     {
         m_throttle = 0.f;
         m_steering = 0.f;
 
-        if (IsKeyDown(KEY_D)) m_steering += m_turnSpeed;
-        if (IsKeyDown(KEY_A)) m_steering -= m_turnSpeed;
+        if (input.right) m_steering += m_turnSpeed;
+        if (input.left) m_steering -= m_turnSpeed;
 
-        if (IsKeyDown(KEY_W)) m_throttle += m_accelerationSpeed;
-        if (IsKeyDown(KEY_S)) m_throttle -= m_decelerationSpeed;
+        if (input.forward) m_throttle += m_accelerationSpeed;
+        if (input.backward) m_throttle -= m_decelerationSpeed;
 
-        m_handBrake = IsKeyDown(KEY_SPACE);
+        m_handBrake = input.handBrake;
 
         if (m_driftBoost) m_throttle *= 1.5f;
-        if (IsKeyDown(KEY_LEFT_SHIFT) && m_boostLevel > 0.f && m_throttle > 0.f) 
+        if (input.boost && m_boostLevel > 0.f && m_throttle > 0.f) 
         {
             m_throttle *= 2.5f;
             m_boostLevel -= 30.f * dt;
         }
     }
 
-    void update(const float dt, Map::MapManager* mapManager)
+    // stats takes the time of the update and of the trails in it
+
+    void update(const float dt, Map::MapManager* mapManager, SimStats* stats = nullptr)
     {   
+        const auto updateStart = stats ? SimStats::now() : std::chrono::steady_clock::time_point{};
+
+        m_prevPos = m_pos;
+        m_prevRotation = m_rotation;
+
         // calculate rotation from deg in rad and set rotation always in between 0 an 360
 
         float rad = m_rotation * (PI / 180.f);
@@ -152,11 +211,9 @@ public:
 
         // add a trail when drifting
 
-        m_trails.addTrail(forward, sideways, forwardSpeed, sidewaysSpeed, m_size, m_pos, m_rotationOffset, m_rotation, m_handBrake, dt);
-
-        // update car AABB
-
-        m_carAABB = getCarAABB(forward, sideways);
+        const auto trailStart = stats ? SimStats::now() : std::chrono::steady_clock::time_point{};
+        m_trails.addTrail(forward, sideways, forwardSpeed, sidewaysSpeed, m_size, m_pos, m_rotationOffset, m_handBrake, dt);
+        if (stats) SimStats::add(stats->trailNanoseconds, trailStart);
 
         // get time of drift and update boost logic
 
@@ -175,7 +232,11 @@ public:
                 if (m_driftTimer > 2) m_boostLevel += 10;
                 if (m_driftTimer > 3) m_boostLevel += 10;
 
-                std::cout << "Drift: " << std::fixed << std::setprecision(1) << m_driftTimer << " Sekunden!" << std::endl;
+                if (m_logDrifts)
+                {
+                    std::lock_guard<std::mutex> lock(logMutex());
+                    std::cout << "Drift: " << std::fixed << std::setprecision(1) << m_driftTimer << " Sekunden!" << std::endl;
+                }
             }
             m_driftTimer = 0.f;
         }
@@ -190,35 +251,40 @@ public:
 
         m_vel = Vector2Add(forward, sideways);
         m_pos += Vector2Scale(m_vel, dt);
+
+        if (stats) SimStats::add(stats->updateNanoseconds, updateStart);
     }
 
-    void handleCollision(Map::MapManager* mapManager)
+    // simulation stage after update: push the car out of the walls and bounce it off them
+    // returns the number of contacts, with collision debug on the touched cells are kept for render
+    // colMap is the Map::CollisionMap of the current map or a streamed Map::ChunkedWorld
+
+    template <typename Grid>
+    int resolveCollision(const Grid& colMap)
     {
-        Map::CollisionMap* colMap = mapManager->collisionMap();
+        Collision::OrientedBox box = Collision::carBox(m_pos, m_rotation, m_size, m_rotationOffset);
+        const Vector2 center = box.center;
 
-        Vector2 min = colMap->getRectPos({m_carAABB.x, m_carAABB.y});   
-        Vector2 max = colMap->getRectPos({m_carAABB.x + m_carAABB.width, 
-                                          m_carAABB.y + m_carAABB.height});
+        // swept from the position before update, so fast cars dont tunnel through thin walls
 
-        int minX = fmaxf(fminf(min.x, colMap->width()), 0.f); 
-        int minY = fmaxf(fminf(min.y, colMap->height()), 0.f);
-        int maxX = fmaxf(fminf(max.x + 1.f, colMap->width()), 0.f); 
-        int maxY = fmaxf(fminf(max.y + 1.f, colMap->height()), 0.f);
+        const int contacts = Collision::resolveMovingBox(colMap, box, Vector2Subtract(m_pos, m_prevPos), m_vel, m_wallResponse, 
+                                                         scratchCells(colMap), m_collisionDebug ? &m_debugContacts : nullptr);
+        if (contacts > 0) m_pos += Vector2Subtract(box.center, center);
 
-        for (int y = minY; y < maxY; ++y)
-        {
-            for (int x = minX; x < maxX; ++x)
-            {
-                int i = colMap->getIndexRectPos({(float)x, (float)y});
-                std::optional<Rectangle> collisionRect = colMap->getRect(i);
-                if (collisionRect.has_value())
-                {
-                    DrawRectangleRec(collisionRect.value(), BLUE);
+        // car AABB at the resolved position, render moves it to the interpolated one
 
-                    // m_carAABB - collisionRect collision handeln
-                }
-            }
-        }
+        const float rad = m_rotation * (PI / 180.f);
+        const Vector2 forward = {sinf(rad), -cosf(rad)};
+        m_carAABB = getCarAABB(forward, {-forward.y, forward.x});
+
+        return contacts;
+    }
+
+    // move skid marks that dropped out of the trail buffer into the map decals
+
+    void bakeTrails(Map::MapManager* mapManager)
+    {
+        m_trails.bakeExpired(mapManager->decalMap(), m_trailColor);
     }
 
     Rectangle getCarAABB(Vector2 forward, Vector2 sideways)
@@ -241,23 +307,42 @@ public:
         return {topLeftX, topLeftY, bottomRightX - topLeftX, bottomRightY - topLeftY};
     }
 
-    void render(Map::MapManager* mapManager)
+    // position and rotation between the last two ticks, alpha 0 is the previous and 1 the current tick
+
+    Vector2 getRenderPos(float alpha) const
     {
-        handleCollision(mapManager);
-        for (auto& trail : *m_trails.getTrails())
-        {
-            DrawRectanglePro(trail.rectangle, {trail.rectangle.width/2, trail.rectangle.height/2}, trail.rotation, {80, 80, 80, 150});
-        }
+        return Vector2Lerp(m_prevPos, m_pos, alpha);
+    }
+
+    float getRenderRotation(float alpha) const
+    {
+        // rotation is reset to 0 past 360, dont interpolate over that jump
+
+        if (fabsf(m_rotation - m_prevRotation) > 180.f) return m_rotation;
+        return Lerp(m_prevRotation, m_rotation, alpha);
+    }
+
+    void render(float alpha, RenderStats* stats = nullptr)
+    {
+        // cells touched since the last frame
+
+        for (const Rectangle& cell : m_debugContacts) DrawRectangleRec(cell, BLUE);
+        m_debugContacts.clear();
+
+        m_trails.render(m_trailColor, stats);
         if (m_texture)
         {
+            const Vector2 renderPos = getRenderPos(alpha);
             DrawTexturePro(*m_texture, 
                 {142.f, 131.f, 71.f, 131.f}, 
-                {m_pos.x, m_pos.y, m_size.x, m_size.y}, 
+                {renderPos.x, renderPos.y, m_size.x, m_size.y}, 
                 m_rotationOffset, 
-                m_rotation, 
+                getRenderRotation(alpha), 
                 WHITE);
         }
-        DrawRectangleLines(m_carAABB.x, m_carAABB.y, m_carAABB.width, m_carAABB.height, RED);
+
+        const Vector2 aabbOffset = Vector2Subtract(getRenderPos(alpha), m_pos);
+        DrawRectangleLines(m_carAABB.x + aabbOffset.x, m_carAABB.y + aabbOffset.y, m_carAABB.width, m_carAABB.height, RED);
     }
 
     void tuner()
@@ -301,6 +386,8 @@ public:
             ImGui::InputFloat("Roll Friction", &m_rollFriction, 0.f, 0.f, "%4.f\n");
             ImGui::InputFloat("Air Friction", &m_airFriction, 0.f, 0.f, "%4.f\n");
 
+            if (ImGui::Checkbox("Show Collision", &m_collisionDebug)) m_debugContacts.clear();
+
             ImGui::EndGroup();
         }
 
@@ -312,6 +399,30 @@ public:
     const float getRotation() const {return m_rotation;}
     const float getThrottle() const {return m_throttle;}
 
+    const TrailManager& getTrails() const {return m_trails;}
+
+    void setCollisionDebug(bool enabled) {m_collisionDebug = enabled;}
+    void setLogDrifts(bool enabled) {m_logDrifts = enabled;}
+
+    // collision box of the car, for car against car collision
+
+    Collision::OrientedBox getBox() const
+    {
+        return Collision::carBox(m_pos, m_rotation, m_size, m_rotationOffset);
+    }
+
+    // move the car by the change of its box center and take the new velocity
+
+    void setBox(const Collision::OrientedBox& box, Vector2 vel)
+    {
+        const Vector2 offset = Vector2Subtract(box.center, getBox().center);
+        m_pos += offset;
+        m_vel = vel;
+
+        m_carAABB.x += offset.x;
+        m_carAABB.y += offset.y;
+    }
+
     const Vector2 getVel() const {return m_vel;}
     const Vector2 getPos() const {return m_pos;}
 };
\ No newline at end of file
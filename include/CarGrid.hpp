@@ -0,0 +1,219 @@
+#pragma once
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "Collision.hpp"
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace Collision
+{
+    // separating axis test of two boxes, on overlap normal points from b to a and depth is the overlap along it
+
+    inline bool boxVsBox(const OrientedBox& a, const OrientedBox& b, Vector2& normal, float& depth)
+    {
+        const Vector2 delta = Vector2Subtract(a.center, b.center);
+        const Vector2 axes[4] = {a.axisX, a.axisY, b.axisX, b.axisY};
+
+        depth = INFINITY;
+
+        for (const Vector2& axis : axes)
+        {
+            const float extentA = fabsf(Vector2DotProduct(a.axisX, axis)) * a.halfSize.x + fabsf(Vector2DotProduct(a.axisY, axis)) * a.halfSize.y;
+            const float extentB = fabsf(Vector2DotProduct(b.axisX, axis)) * b.halfSize.x + fabsf(Vector2DotProduct(b.axisY, axis)) * b.halfSize.y;
+            const float distance = Vector2DotProduct(delta, axis);
+            const float overlap = extentA + extentB - fabsf(distance);
+
+            if (overlap <= 0.f) return false;
+            if (overlap < depth)
+            {
+                depth = overlap;
+                normal = distance < 0.f ? Vector2Negate(axis) : axis;
+            }
+        }
+
+        return true;
+    }
+
+    // both boxes move apart by half the depth, the closing speed along the normal is exchanged with restitution
+    // (equal masses), the sliding part loses coulomb friction like against a wall
+
+    inline void resolveBoxPair(OrientedBox& a, Vector2& velA, OrientedBox& b, Vector2& velB, Vector2 normal, float depth, Response response)
+    {
+        const Vector2 push = Vector2Scale(normal, depth * 0.5f);
+        a.center = Vector2Add(a.center, push);
+        b.center = Vector2Subtract(b.center, push);
+
+        const float closing = Vector2DotProduct(Vector2Subtract(velA, velB), normal);
+        if (closing >= 0.f) return;
+
+        const float normalImpulse = -closing * (1.f + response.restitution) * 0.5f;
+        const Vector2 impulse = Vector2Scale(normal, normalImpulse);
+        velA = Vector2Add(velA, impulse);
+        velB = Vector2Subtract(velB, impulse);
+
+        // at most friction times the normal impulse, and never more than stops the sliding
+
+        const Vector2 tangent = {-normal.y, normal.x};
+        const float sliding = Vector2DotProduct(Vector2Subtract(velA, velB), tangent);
+        const float slidingImpulse = fminf(fabsf(sliding) * 0.5f, response.friction * normalImpulse);
+        const Vector2 friction = Vector2Scale(tangent, copysignf(slidingImpulse, sliding));
+        velA = Vector2Subtract(velA, friction);
+        velB = Vector2Add(velB, friction);
+    }
+
+    // broadphase for car against car, a uniform grid over the map rebuilt every tick with a counting sort
+    // every box is in all cells its bounds touch, a pair is only reported by the cell holding the top left
+    // corner of the overlap of their bounds, so no pair comes twice and no set of pairs is needed
+    // boxes outside the map are put into the border cells
+
+    class CarGrid
+    {
+    private:
+        int m_cellSize;
+        int m_cellsX;
+        int m_cellsY;
+
+        std::vector<Rectangle> m_bounds;
+
+        std::vector<int> m_cellStart;
+        std::vector<int> m_cellFill;
+        std::vector<int> m_occupied;
+        std::vector<int> m_entries;
+
+        size_t m_testedPairs{0};
+
+        int cellX(float x) const {return std::clamp((int)floorf(x / m_cellSize), 0, m_cellsX - 1);}
+        int cellY(float y) const {return std::clamp((int)floorf(y / m_cellSize), 0, m_cellsY - 1);}
+
+        template<typename Visit>
+        void forEachCell(const Rectangle& bounds, Visit visit) const
+        {
+            const int minX = cellX(bounds.x);
+            const int minY = cellY(bounds.y);
+            const int maxX = cellX(bounds.x + bounds.width);
+            const int maxY = cellY(bounds.y + bounds.height);
+
+            for (int y = minY; y <= maxY; ++y)
+            {
+                for (int x = minX; x <= maxX; ++x) visit(y * m_cellsX + x);
+            }
+        }
+
+    public:
+        // the same cell size as the collision map keeps cars in at most four cells
+
+        CarGrid(int cellSize, int worldWidth, int worldHeight)
+            : m_cellSize(cellSize)
+            , m_cellsX(std::max((worldWidth + cellSize - 1) / cellSize, 1))
+            , m_cellsY(std::max((worldHeight + cellSize - 1) / cellSize, 1))
+        {
+            m_cellStart.assign((size_t)m_cellsX * m_cellsY + 1, 0);
+            m_cellFill.assign((size_t)m_cellsX * m_cellsY, 0);
+        }
+
+        void rebuild(const std::vector<OrientedBox>& boxes)
+        {
+            m_bounds.resize(boxes.size());
+
+            // clear the cells of the last tick only
+
+            for (int cell : m_occupied) m_cellStart[cell] = 0;
+            m_occupied.clear();
+
+            // count, the counts are kept in m_cellStart until the prefix sum
+
+            for (size_t i = 0; i < boxes.size(); ++i)
+            {
+                m_bounds[i] = boundingRect(boxes[i]);
+                forEachCell(m_bounds[i], [this](int cell)
+                {
+                    if (m_cellStart[cell]++ == 0) m_occupied.push_back(cell);
+                });
+            }
+
+            // offsets in m_entries, only over the occupied cells
+
+            int offset = 0;
+            for (int cell : m_occupied)
+            {
+                const int count = m_cellStart[cell];
+                m_cellStart[cell] = offset;
+                m_cellFill[cell] = offset;
+                offset += count;
+            }
+            m_entries.resize(offset);
+
+            for (size_t i = 0; i < boxes.size(); ++i)
+            {
+                forEachCell(m_bounds[i], [this, i](int cell) {m_entries[m_cellFill[cell]++] = (int)i;});
+            }
+        }
+
+        // calls visit(i, j) once for every pair whose bounds overlap
+
+        template<typename Visit>
+        void forEachPair(Visit visit)
+        {
+            m_testedPairs = 0;
+
+            for (int cell : m_occupied)
+            {
+                const int begin = m_cellStart[cell];
+                const int end = m_cellFill[cell];
+
+                for (int a = begin; a < end; ++a)
+                {
+                    const int i = m_entries[a];
+                    const Rectangle& boundsA = m_bounds[i];
+
+                    for (int b = a + 1; b < end; ++b)
+                    {
+                        const int j = m_entries[b];
+                        const Rectangle& boundsB = m_bounds[j];
+                        ++m_testedPairs;
+
+                        const float overlapX = fmaxf(boundsA.x, boundsB.x);
+                        const float overlapY = fmaxf(boundsA.y, boundsB.y);
+
+                        if (overlapX > fminf(boundsA.x + boundsA.width, boundsB.x + boundsB.width) ||
+                            overlapY > fminf(boundsA.y + boundsA.height, boundsB.y + boundsB.height)) continue;
+
+                        if (cellY(overlapY) * m_cellsX + cellX(overlapX) != cell) continue;
+
+                        visit(i, j);
+                    }
+                }
+            }
+        }
+
+        // bounds pairs tested by the last forEachPair
+
+        size_t testedPairs() const {return m_testedPairs;}
+    };
+
+    // rebuild the grid, run the box test on its pairs and separate the boxes that overlap
+    // returns the number of contacts, boxes and vels are changed in place
+
+    inline size_t resolveBoxes(CarGrid& grid, std::vector<OrientedBox>& boxes, std::vector<Vector2>& vels, Response response)
+    {
+        grid.rebuild(boxes);
+
+        size_t contacts = 0;
+
+        grid.forEachPair([&](int i, int j)
+        {
+            Vector2 normal{};
+            float depth{};
+            if (!boxVsBox(boxes[i], boxes[j], normal, depth)) return;
+
+            resolveBoxPair(boxes[i], vels[i], boxes[j], vels[j], normal, depth, response);
+            ++contacts;
+        });
+
+        return contacts;
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// input of one car for one tick, filled by the keyboard or by a script
+
+struct CarInput
+{
+    bool forward{false};
+    bool backward{false};
+    bool left{false};
+    bool right{false};
+    bool handBrake{false};
+    bool boost{false};
+};
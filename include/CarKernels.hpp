@@ -0,0 +1,347 @@
+#pragma once
+
+#include <raylib.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <bit>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// batched math for CarSystem, processes 8 cars per instruction with AVX2 (build with -mavx2),
+// 4 with SSE2 and falls back to scalar code for the rest
+//
+// every path runs the same operations in the same order, so SIMD and scalar results are bit identical
+// (only the sign of a zero min/max can differ). against the libm reference the error is at most
+// sinDegTolerance / expTolerance, see racingGameHeadless check-kernels. this needs -ffp-contract=off,
+// which is the default for -std=c++20
+
+namespace Kernels
+{
+    // error against sinf, cosf and expf, absolute for sin/cos of -360..360 deg, relative for exp of -200..0
+    // measured maximum is 6e-8 for sin/cos and 1.2e-7 (1 ulp) for exp
+
+    constexpr float sinDegTolerance = 2.5e-7f;
+    constexpr float expTolerance = 2.5e-7f;
+
+    // one set of operations per instruction set, the kernels below are written once against these
+
+    struct ScalarOps
+    {
+        using F = float;
+        using I = int32_t;
+        using M = bool;
+
+        static constexpr size_t width = 1;
+
+        static F load(const float* p) {return *p;}
+        static void store(float* p, F v) {*p = v;}
+        static F set(float v) {return v;}
+
+        static F add(F a, F b) {return a + b;}
+        static F sub(F a, F b) {return a - b;}
+        static F mul(F a, F b) {return a * b;}
+        static F min(F a, F b) {return fminf(a, b);}
+        static F max(F a, F b) {return fmaxf(a, b);}
+        static F neg(F a) {return -a;}
+
+        static I roundToInt(F a) {return (I)lrintf(a);}
+        static F toFloat(I a) {return (F)a;}
+        static I andInt(I a, int b) {return a & b;}
+        static I addInt(I a, int b) {return a + b;}
+        static F asFloatShifted(I a) {return std::bit_cast<float>((uint32_t)a << 23);}
+
+        static M isZero(I a) {return a == 0;}
+        static F select(M m, F a, F b) {return m ? a : b;}
+    };
+
+#if defined(__SSE2__)
+    struct SseOps
+    {
+        using F = __m128;
+        using I = __m128i;
+        using M = __m128;
+
+        static constexpr size_t width = 4;
+
+        static F load(const float* p) {return _mm_loadu_ps(p);}
+        static void store(float* p, F v) {_mm_storeu_ps(p, v);}
+        static F set(float v) {return _mm_set1_ps(v);}
+
+        static F add(F a, F b) {return _mm_add_ps(a, b);}
+        static F sub(F a, F b) {return _mm_sub_ps(a, b);}
+        static F mul(F a, F b) {return _mm_mul_ps(a, b);}
+        static F min(F a, F b) {return _mm_min_ps(a, b);}
+        static F max(F a, F b) {return _mm_max_ps(a, b);}
+        static F neg(F a) {return _mm_xor_ps(a, _mm_set1_ps(-0.f));}
+
+        static I roundToInt(F a) {return _mm_cvtps_epi32(a);}
+        static F toFloat(I a) {return _mm_cvtepi32_ps(a);}
+        static I andInt(I a, int b) {return _mm_and_si128(a, _mm_set1_epi32(b));}
+        static I addInt(I a, int b) {return _mm_add_epi32(a, _mm_set1_epi32(b));}
+        static F asFloatShifted(I a) {return _mm_castsi128_ps(_mm_slli_epi32(a, 23));}
+
+        static M isZero(I a) {return _mm_castsi128_ps(_mm_cmpeq_epi32(a, _mm_setzero_si128()));}
+        static F select(M m, F a, F b) {return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));}
+    };
+#endif
+
+#if defined(__AVX2__)
+    struct AvxOps
+    {
+        using F = __m256;
+        using I = __m256i;
+        using M = __m256;
+
+        static constexpr size_t width = 8;
+
+        static F load(const float* p) {return _mm256_loadu_ps(p);}
+        static void store(float* p, F v) {_mm256_storeu_ps(p, v);}
+        static F set(float v) {return _mm256_set1_ps(v);}
+
+        static F add(F a, F b) {return _mm256_add_ps(a, b);}
+        static F sub(F a, F b) {return _mm256_sub_ps(a, b);}
+        static F mul(F a, F b) {return _mm256_mul_ps(a, b);}
+        static F min(F a, F b) {return _mm256_min_ps(a, b);}
+        static F max(F a, F b) {return _mm256_max_ps(a, b);}
+        static F neg(F a) {return _mm256_xor_ps(a, _mm256_set1_ps(-0.f));}
+
+        static I roundToInt(F a) {return _mm256_cvtps_epi32(a);}
+        static F toFloat(I a) {return _mm256_cvtepi32_ps(a);}
+        static I andInt(I a, int b) {return _mm256_and_si256(a, _mm256_set1_epi32(b));}
+        static I addInt(I a, int b) {return _mm256_add_epi32(a, _mm256_set1_epi32(b));}
+        static F asFloatShifted(I a) {return _mm256_castsi256_ps(_mm256_slli_epi32(a, 23));}
+
+        static M isZero(I a) {return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, _mm256_setzero_si256()));}
+        static F select(M m, F a, F b) {return _mm256_blendv_ps(b, a, m);}
+    };
+#endif
+
+    // sin and cos of an angle in degrees, cephes polynomials after reduction to -pi/4..pi/4
+
+    template<typename Ops>
+    inline void sinCosDeg(typename Ops::F deg, typename Ops::F& sinOut, typename Ops::F& cosOut)
+    {
+        using F = typename Ops::F;
+        using I = typename Ops::I;
+
+        const F rad = Ops::mul(deg, Ops::set(PI / 180.f));
+
+        const I j = Ops::roundToInt(Ops::mul(rad, Ops::set(2.f / PI)));
+        const F jf = Ops::toFloat(j);
+
+        F y = Ops::sub(rad, Ops::mul(jf, Ops::set(1.5703125f)));
+        y = Ops::sub(y, Ops::mul(jf, Ops::set(4.837512969970703125e-4f)));
+        y = Ops::sub(y, Ops::mul(jf, Ops::set(7.54978995489188216e-8f)));
+
+        const F z = Ops::mul(y, y);
+
+        F s = Ops::add(Ops::mul(Ops::set(-1.9515295891e-4f), z), Ops::set(8.3321608736e-3f));
+        s = Ops::add(Ops::mul(s, z), Ops::set(-1.6666654611e-1f));
+        s = Ops::add(Ops::mul(Ops::mul(s, z), y), y);
+
+        F c = Ops::add(Ops::mul(Ops::set(2.443315711809948e-5f), z), Ops::set(-1.388731625493765e-3f));
+        c = Ops::add(Ops::mul(c, z), Ops::set(4.166664568298827e-2f));
+        c = Ops::mul(Ops::mul(c, z), z);
+        c = Ops::add(Ops::sub(c, Ops::mul(z, Ops::set(0.5f))), Ops::set(1.f));
+
+        // quadrant: odd swaps sin and cos, sign from bit 2
+
+        const I quadrant = Ops::andInt(j, 3);
+        const auto even = Ops::isZero(Ops::andInt(quadrant, 1));
+
+        const F sinValue = Ops::select(even, s, c);
+        const F cosValue = Ops::select(even, c, s);
+
+        sinOut = Ops::select(Ops::isZero(Ops::andInt(quadrant, 2)), sinValue, Ops::neg(sinValue));
+        cosOut = Ops::select(Ops::isZero(Ops::andInt(Ops::addInt(quadrant, 1), 2)), cosValue, Ops::neg(cosValue));
+    }
+
+    // e^x, cephes polynomial with 2^n scaling
+
+    template<typename Ops>
+    inline typename Ops::F exp(typename Ops::F x)
+    {
+        using F = typename Ops::F;
+        using I = typename Ops::I;
+
+        x = Ops::min(Ops::max(x, Ops::set(-87.3f)), Ops::set(88.3f));
+
+        const I n = Ops::roundToInt(Ops::mul(x, Ops::set(1.44269504088896341f)));
+        const F nf = Ops::toFloat(n);
+
+        F r = Ops::sub(x, Ops::mul(nf, Ops::set(0.693359375f)));
+        r = Ops::sub(r, Ops::mul(nf, Ops::set(-2.12194440e-4f)));
+
+        const F z = Ops::mul(r, r);
+
+        F y = Ops::add(Ops::mul(Ops::set(1.9875691500e-4f), r), Ops::set(1.3981999507e-3f));
+        y = Ops::add(Ops::mul(y, r), Ops::set(8.3334519073e-3f));
+        y = Ops::add(Ops::mul(y, r), Ops::set(4.1665795894e-2f));
+        y = Ops::add(Ops::mul(y, r), Ops::set(1.6666665459e-1f));
+        y = Ops::add(Ops::mul(y, r), Ops::set(5.0000001201e-1f));
+        y = Ops::add(Ops::add(Ops::mul(y, z), r), Ops::set(1.f));
+
+        return Ops::mul(y, Ops::asFloatShifted(Ops::addInt(n, 127)));
+    }
+
+    // array drivers, widest instruction set first, scalar for the rest
+
+    template<typename Ops>
+    inline size_t sinCosDegRange(const float* deg, float* sinOut, float* cosOut, size_t begin, size_t end)
+    {
+        size_t i = begin;
+        for (; i + Ops::width <= end; i += Ops::width)
+        {
+            typename Ops::F s, c;
+            sinCosDeg<Ops>(Ops::load(deg + i), s, c);
+            Ops::store(sinOut + i, s);
+            Ops::store(cosOut + i, c);
+        }
+        return i;
+    }
+
+    template<typename Ops>
+    inline size_t expRange(const float* x, float* out, size_t begin, size_t end)
+    {
+        size_t i = begin;
+        for (; i + Ops::width <= end; i += Ops::width)
+        {
+            Ops::store(out + i, exp<Ops>(Ops::load(x + i)));
+        }
+        return i;
+    }
+
+    // forward and sideways speed: dot products of the velocity with forward and sideways = (-forward.y, forward.x)
+
+    template<typename Ops>
+    inline size_t projectRange(const float* velX, const float* velY, const float* forwardX, const float* forwardY,
+                               float* forwardSpeed, float* sidewaysSpeed, size_t begin, size_t end)
+    {
+        size_t i = begin;
+        for (; i + Ops::width <= end; i += Ops::width)
+        {
+            const auto vx = Ops::load(velX + i);
+            const auto vy = Ops::load(velY + i);
+            const auto fx = Ops::load(forwardX + i);
+            const auto fy = Ops::load(forwardY + i);
+
+            Ops::store(forwardSpeed + i, Ops::add(Ops::mul(vx, fx), Ops::mul(vy, fy)));
+            Ops::store(sidewaysSpeed + i, Ops::add(Ops::mul(vx, Ops::neg(fy)), Ops::mul(vy, fx)));
+        }
+        return i;
+    }
+
+    // axis aligned box around the rotated car, same corners and order as Car::getCarAABB
+
+    template<typename Ops>
+    inline size_t aabbRange(const float* posX, const float* posY, const float* forwardX, const float* forwardY,
+                            float sizeX, float sizeY, float offsetY,
+                            float* minX, float* minY, float* maxX, float* maxY, size_t begin, size_t end)
+    {
+        size_t i = begin;
+        for (; i + Ops::width <= end; i += Ops::width)
+        {
+            const auto fx = Ops::load(forwardX + i);
+            const auto fy = Ops::load(forwardY + i);
+            const auto sx = Ops::neg(fy);
+            const auto sy = fx;
+
+            const auto fwdPX = Ops::mul(fx, Ops::set(offsetY));
+            const auto fwdPY = Ops::mul(fy, Ops::set(offsetY));
+            const auto bwdPX = Ops::mul(fx, Ops::set(offsetY - sizeY));
+            const auto bwdPY = Ops::mul(fy, Ops::set(offsetY - sizeY));
+            const auto rgtPX = Ops::mul(sx, Ops::set(sizeX * 0.5f));
+            const auto rgtPY = Ops::mul(sy, Ops::set(sizeX * 0.5f));
+            const auto lftPX = Ops::mul(sx, Ops::set(-sizeX * 0.5f));
+            const auto lftPY = Ops::mul(sy, Ops::set(-sizeX * 0.5f));
+
+            const auto fwdRgtX = Ops::add(fwdPX, rgtPX);
+            const auto fwdRgtY = Ops::add(fwdPY, rgtPY);
+            const auto fwdLftX = Ops::add(fwdPX, lftPX);
+            const auto fwdLftY = Ops::add(fwdPY, lftPY);
+            const auto bwdRgtX = Ops::add(bwdPX, rgtPX);
+            const auto bwdRgtY = Ops::add(bwdPY, rgtPY);
+            const auto bwdLftX = Ops::add(bwdPX, lftPX);
+            const auto bwdLftY = Ops::add(bwdPY, lftPY);
+
+            const auto px = Ops::load(posX + i);
+            const auto py = Ops::load(posY + i);
+
+            Ops::store(minX + i, Ops::add(Ops::min(Ops::min(fwdRgtX, fwdLftX), Ops::min(bwdRgtX, bwdLftX)), px));
+            Ops::store(minY + i, Ops::add(Ops::min(Ops::min(fwdRgtY, fwdLftY), Ops::min(bwdRgtY, bwdLftY)), py));
+            Ops::store(maxX + i, Ops::add(Ops::max(Ops::max(fwdRgtX, fwdLftX), Ops::max(bwdRgtX, bwdLftX)), px));
+            Ops::store(maxY + i, Ops::add(Ops::max(Ops::max(fwdRgtY, fwdLftY), Ops::max(bwdRgtY, bwdLftY)), py));
+        }
+        return i;
+    }
+
+    // entry points, pick the widest available instruction set
+
+    inline void sinCosDeg(const float* deg, float* sinOut, float* cosOut, size_t count)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        i = sinCosDegRange<AvxOps>(deg, sinOut, cosOut, i, count);
+#endif
+#if defined(__SSE2__)
+        i = sinCosDegRange<SseOps>(deg, sinOut, cosOut, i, count);
+#endif
+        sinCosDegRange<ScalarOps>(deg, sinOut, cosOut, i, count);
+    }
+
+    inline void exp(const float* x, float* out, size_t count)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        i = expRange<AvxOps>(x, out, i, count);
+#endif
+#if defined(__SSE2__)
+        i = expRange<SseOps>(x, out, i, count);
+#endif
+        expRange<ScalarOps>(x, out, i, count);
+    }
+
+    inline void project(const float* velX, const float* velY, const float* forwardX, const float* forwardY,
+                        float* forwardSpeed, float* sidewaysSpeed, size_t count)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        i = projectRange<AvxOps>(velX, velY, forwardX, forwardY, forwardSpeed, sidewaysSpeed, i, count);
+#endif
+#if defined(__SSE2__)
+        i = projectRange<SseOps>(velX, velY, forwardX, forwardY, forwardSpeed, sidewaysSpeed, i, count);
+#endif
+        projectRange<ScalarOps>(velX, velY, forwardX, forwardY, forwardSpeed, sidewaysSpeed, i, count);
+    }
+
+    inline void aabb(const float* posX, const float* posY, const float* forwardX, const float* forwardY,
+                     float sizeX, float sizeY, float offsetY,
+                     float* minX, float* minY, float* maxX, float* maxY, size_t count)
+    {
+        size_t i = 0;
+#if defined(__AVX2__)
+        i = aabbRange<AvxOps>(posX, posY, forwardX, forwardY, sizeX, sizeY, offsetY, minX, minY, maxX, maxY, i, count);
+#endif
+#if defined(__SSE2__)
+        i = aabbRange<SseOps>(posX, posY, forwardX, forwardY, sizeX, sizeY, offsetY, minX, minY, maxX, maxY, i, count);
+#endif
+        aabbRange<ScalarOps>(posX, posY, forwardX, forwardY, sizeX, sizeY, offsetY, minX, minY, maxX, maxY, i, count);
+    }
+
+    // name of the widest instruction set in use
+
+    inline const char* instructionSet()
+    {
+#if defined(__AVX2__)
+        return "AVX2";
+#elif defined(__SSE2__)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+}
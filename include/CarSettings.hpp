@@ -0,0 +1,32 @@
+#pragma once
+
+#include <raylib.h>
+
+#include "Car.hpp"
+
+#include <cstddef>
+
+// tuning values of the game car, the game and the headless tools build their cars from the same values
+// so a replay recorded in the game drives the same in the headless driver
+
+struct CarSettings
+{
+    float trailTime{0.001f};
+    size_t maxTrails{4096};
+
+    float accelerationSpeed{500.f};
+    float decelerationSpeed{400.f};
+    float turnSpeed{10.f};
+
+    float rollFriction{0.03f};
+    float airFriction{0.03f};
+    float grip{5.f};
+
+    Vector2 size{30.f, 60.f};
+
+    Car makeCar(Vector2 pos, Texture2D* texture = nullptr) const
+    {
+        return Car(trailTime, maxTrails, accelerationSpeed, decelerationSpeed,
+                   turnSpeed, rollFriction, airFriction, grip, pos, size, texture);
+    }
+};
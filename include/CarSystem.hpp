@@ -0,0 +1,436 @@
+#pragma once
+
+#include "CarInput.hpp"
+#include "CarKernels.hpp"
+#include "Collision.hpp"
+#include "CarGrid.hpp"
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include <vector>
+#include <cstdint>
+
+// tuning values shared by every car of a CarSystem
+
+struct CarParams
+{
+    float accelerationSpeed;
+    float decelerationSpeed;
+    float turnSpeed;
+
+    float rollFriction;
+    float airFriction;
+
+    float normalGrip;
+    float handbrakeGrip;
+
+    float staticGripSpeed{100.f};
+    float staticGripFactor{200.f};
+    float gripFactor{10.f};
+
+    Vector2 size{30.f, 60.f};
+
+    Collision::Response wallResponse{};
+};
+
+// many cars without trails or textures, stored as structure of arrays and updated in one pass
+// uses the same drift and grip model as Car::update
+
+class CarSystem
+{
+private:
+    CarParams m_params;
+
+    std::vector<float> m_posX;
+    std::vector<float> m_posY;
+    std::vector<float> m_velX;
+    std::vector<float> m_velY;
+    std::vector<float> m_rotation;
+
+    std::vector<float> m_throttle;
+    std::vector<float> m_steering;
+    std::vector<float> m_grip;
+    std::vector<float> m_boostLevel;
+    std::vector<float> m_driftTimer;
+
+    std::vector<uint8_t> m_handBrake;
+    std::vector<uint8_t> m_driftBoost;
+
+    // car AABBs, written by updateBatched
+
+    std::vector<float> m_minX;
+    std::vector<float> m_minY;
+    std::vector<float> m_maxX;
+    std::vector<float> m_maxY;
+
+    // scratch arrays of updateBatched, kept to not allocate every tick
+
+    std::vector<float> m_forwardX;
+    std::vector<float> m_forwardY;
+    std::vector<float> m_forwardSpeed;
+    std::vector<float> m_sidewaysSpeed;
+    std::vector<float> m_gripDecay;
+
+    // scratch of resolveCollisions and resolveCarCollisions
+
+    std::vector<int> m_solidCells;
+    std::vector<Collision::OrientedBox> m_boxes;
+    std::vector<Vector2> m_boxVels;
+    std::vector<Vector2> m_boxCenters;
+
+public:
+    CarSystem(const CarParams& params) : m_params(params) {}
+
+    ~CarSystem() = default;
+
+    void reserve(size_t count)
+    {
+        m_posX.reserve(count);
+        m_posY.reserve(count);
+        m_velX.reserve(count);
+        m_velY.reserve(count);
+        m_rotation.reserve(count);
+        m_throttle.reserve(count);
+        m_steering.reserve(count);
+        m_grip.reserve(count);
+        m_boostLevel.reserve(count);
+        m_driftTimer.reserve(count);
+        m_handBrake.reserve(count);
+        m_driftBoost.reserve(count);
+        m_minX.reserve(count);
+        m_minY.reserve(count);
+        m_maxX.reserve(count);
+        m_maxY.reserve(count);
+    }
+
+    size_t addCar(Vector2 startPos, float rotation = 0.f)
+    {
+        m_posX.push_back(startPos.x);
+        m_posY.push_back(startPos.y);
+        m_velX.push_back(0.f);
+        m_velY.push_back(0.f);
+        m_rotation.push_back(rotation);
+        m_throttle.push_back(0.f);
+        m_steering.push_back(0.f);
+        m_grip.push_back(m_params.normalGrip);
+        m_boostLevel.push_back(100.f);
+        m_driftTimer.push_back(0.f);
+        m_handBrake.push_back(0);
+        m_driftBoost.push_back(0);
+        m_minX.push_back(startPos.x);
+        m_minY.push_back(startPos.y);
+        m_maxX.push_back(startPos.x);
+        m_maxY.push_back(startPos.y);
+
+        return m_posX.size() - 1;
+    }
+
+    // same as Car::applyInput
+
+    void applyInput(size_t i, const CarInput& input, const float dt)
+    {
+        float throttle = 0.f;
+        float steering = 0.f;
+
+        if (input.right) steering += m_params.turnSpeed;
+        if (input.left) steering -= m_params.turnSpeed;
+
+        if (input.forward) throttle += m_params.accelerationSpeed;
+        if (input.backward) throttle -= m_params.decelerationSpeed;
+
+        m_handBrake[i] = input.handBrake;
+
+        if (m_driftBoost[i]) throttle *= 1.5f;
+        if (input.boost && m_boostLevel[i] > 0.f && throttle > 0.f)
+        {
+            throttle *= 2.5f;
+            m_boostLevel[i] -= 30.f * dt;
+        }
+
+        m_throttle[i] = throttle;
+        m_steering[i] = steering;
+    }
+
+    // advance all cars by one tick, reference version with libm trig, matches Car::update exactly
+
+    void update(const float dt)
+    {
+        const CarParams p = m_params;
+        const size_t count = m_posX.size();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            float rad = m_rotation[i] * (PI / 180.f);
+
+            float forwardX = sinf(rad);
+            float forwardY = -cosf(rad);
+            float sidewaysX = -forwardY;
+            float sidewaysY = forwardX;
+
+            float velX = m_velX[i] + m_throttle[i] * forwardX * dt;
+            float velY = m_velY[i] + m_throttle[i] * forwardY * dt;
+
+            float forwardSpeed = velX * forwardX + velY * forwardY;
+            float sidewaysSpeed = velX * sidewaysX + velY * sidewaysY;
+
+            // rotation, uses the grip of the last tick like Car::update
+
+            float drift = fminf(fabsf(sidewaysSpeed)/fabsf(forwardSpeed) + 1e-3f, 1.f);
+            float driftFactor = 1.f + drift * (p.normalGrip/(m_grip[i] + 1e-6f) - 1.f) * 0.2f;
+            float speedFactor = forwardSpeed * fmaxf(150.f / (fabsf(forwardSpeed) + 150.f), 0.2f);
+
+            float rotation = m_rotation[i] + m_steering[i] * speedFactor * driftFactor * 0.1f * dt;
+            if (fabsf(rotation) > 360.f) rotation = 0.f;
+            m_rotation[i] = rotation;
+
+            // handbrake and friction
+
+            float grip = p.normalGrip;
+
+            if (m_handBrake[i])
+            {
+                grip = p.handbrakeGrip;
+                if (forwardSpeed < 0) forwardSpeed = fminf(forwardSpeed + p.decelerationSpeed * dt, 0);
+                else forwardSpeed = fmaxf(forwardSpeed - p.decelerationSpeed * dt, 0);
+            }
+            m_grip[i] = grip;
+
+            float friction = (p.airFriction * fabsf(forwardSpeed) * p.rollFriction * dt);
+            forwardSpeed /= 1.f + friction;
+
+            // sideways grip
+
+            sidewaysSpeed *= expf(-grip * dt);
+
+            float scaledGrip = grip * p.gripFactor;
+            if (forwardSpeed < p.staticGripSpeed) scaledGrip = grip * p.staticGripFactor;
+
+            if (sidewaysSpeed < 0) sidewaysSpeed = fminf(sidewaysSpeed + grip * scaledGrip * dt, 0);
+            else sidewaysSpeed = fmaxf(sidewaysSpeed - grip * scaledGrip * dt, 0);
+
+            // drift boost
+
+            m_driftBoost[i] = 0;
+
+            if (drift >= 0.5f && forwardSpeed > 5.f && fabsf(sidewaysSpeed) > 5.f)
+            {
+                m_driftTimer[i] += dt;
+                m_driftBoost[i] = 1;
+            }
+            else if (m_driftTimer[i] > 0)
+            {
+                float boost = m_boostLevel[i];
+                if (m_driftTimer[i] > 1)
+                {
+                    boost += 10;
+                    if (m_driftTimer[i] > 2) boost += 10;
+                    if (m_driftTimer[i] > 3) boost += 10;
+                }
+                m_boostLevel[i] = boost;
+                m_driftTimer[i] = 0.f;
+            }
+
+            m_boostLevel[i] = fminf(fmaxf(m_boostLevel[i], 0.f), 100.f);
+
+            // new velocity and position
+
+            velX = forwardX * forwardSpeed + sidewaysX * sidewaysSpeed;
+            velY = forwardY * forwardSpeed + sidewaysY * sidewaysSpeed;
+
+            m_velX[i] = velX;
+            m_velY[i] = velY;
+            m_posX[i] += velX * dt;
+            m_posY[i] += velY * dt;
+        }
+    }
+
+    // advance all cars by one tick with the SIMD kernels for trig, grip decay and AABBs
+    // same model as update, within the tolerance of Kernels::sinDegTolerance and Kernels::expTolerance
+
+    void updateBatched(const float dt)
+    {
+        const CarParams p = m_params;
+        const size_t count = m_posX.size();
+
+        m_forwardX.resize(count);
+        m_forwardY.resize(count);
+        m_forwardSpeed.resize(count);
+        m_sidewaysSpeed.resize(count);
+        m_gripDecay.resize(count);
+
+        // grip of this tick is known from the handbrake, so the decay can be batched up front
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_gripDecay[i] = -(m_handBrake[i] ? p.handbrakeGrip : p.normalGrip) * dt;
+        }
+
+        Kernels::exp(m_gripDecay.data(), m_gripDecay.data(), count);
+        Kernels::sinCosDeg(m_rotation.data(), m_forwardX.data(), m_forwardY.data(), count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_forwardY[i] = -m_forwardY[i];
+            m_velX[i] += m_throttle[i] * m_forwardX[i] * dt;
+            m_velY[i] += m_throttle[i] * m_forwardY[i] * dt;
+        }
+
+        Kernels::project(m_velX.data(), m_velY.data(), m_forwardX.data(), m_forwardY.data(),
+                         m_forwardSpeed.data(), m_sidewaysSpeed.data(), count);
+
+        // branchy part of the model stays scalar
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float forwardX = m_forwardX[i];
+            const float forwardY = m_forwardY[i];
+            float forwardSpeed = m_forwardSpeed[i];
+            float sidewaysSpeed = m_sidewaysSpeed[i];
+
+            float drift = fminf(fabsf(sidewaysSpeed)/fabsf(forwardSpeed) + 1e-3f, 1.f);
+            float driftFactor = 1.f + drift * (p.normalGrip/(m_grip[i] + 1e-6f) - 1.f) * 0.2f;
+            float speedFactor = forwardSpeed * fmaxf(150.f / (fabsf(forwardSpeed) + 150.f), 0.2f);
+
+            float rotation = m_rotation[i] + m_steering[i] * speedFactor * driftFactor * 0.1f * dt;
+            if (fabsf(rotation) > 360.f) rotation = 0.f;
+            m_rotation[i] = rotation;
+
+            float grip = p.normalGrip;
+
+            if (m_handBrake[i])
+            {
+                grip = p.handbrakeGrip;
+                if (forwardSpeed < 0) forwardSpeed = fminf(forwardSpeed + p.decelerationSpeed * dt, 0);
+                else forwardSpeed = fmaxf(forwardSpeed - p.decelerationSpeed * dt, 0);
+            }
+            m_grip[i] = grip;
+
+            float friction = (p.airFriction * fabsf(forwardSpeed) * p.rollFriction * dt);
+            forwardSpeed /= 1.f + friction;
+
+            sidewaysSpeed *= m_gripDecay[i];
+
+            float scaledGrip = grip * p.gripFactor;
+            if (forwardSpeed < p.staticGripSpeed) scaledGrip = grip * p.staticGripFactor;
+
+            if (sidewaysSpeed < 0) sidewaysSpeed = fminf(sidewaysSpeed + grip * scaledGrip * dt, 0);
+            else sidewaysSpeed = fmaxf(sidewaysSpeed - grip * scaledGrip * dt, 0);
+
+            m_driftBoost[i] = 0;
+
+            if (drift >= 0.5f && forwardSpeed > 5.f && fabsf(sidewaysSpeed) > 5.f)
+            {
+                m_driftTimer[i] += dt;
+                m_driftBoost[i] = 1;
+            }
+            else if (m_driftTimer[i] > 0)
+            {
+                float boost = m_boostLevel[i];
+                if (m_driftTimer[i] > 1)
+                {
+                    boost += 10;
+                    if (m_driftTimer[i] > 2) boost += 10;
+                    if (m_driftTimer[i] > 3) boost += 10;
+                }
+                m_boostLevel[i] = boost;
+                m_driftTimer[i] = 0.f;
+            }
+
+            m_boostLevel[i] = fminf(fmaxf(m_boostLevel[i], 0.f), 100.f);
+
+            const float velX = forwardX * forwardSpeed + -forwardY * sidewaysSpeed;
+            const float velY = forwardY * forwardSpeed + forwardX * sidewaysSpeed;
+
+            m_velX[i] = velX;
+            m_velY[i] = velY;
+            m_posX[i] += velX * dt;
+            m_posY[i] += velY * dt;
+        }
+
+        // AABBs use the direction of this tick, like Car::update
+
+        Kernels::aabb(m_posX.data(), m_posY.data(), m_forwardX.data(), m_forwardY.data(),
+                      p.size.x, p.size.y, 0.8f * p.size.y,
+                      m_minX.data(), m_minY.data(), m_maxX.data(), m_maxY.data(), count);
+    }
+
+    // push every car out of the walls of the map, same response as Car::resolveCollision
+    // runs after update or updateBatched with the same dt, the move of the tick is vel * dt, returns the number of contacts
+
+    size_t resolveCollisions(const Map::CollisionMap& colMap, const float dt)
+    {
+        const CarParams p = m_params;
+        const Vector2 offset = {0.5f * p.size.x, 0.8f * p.size.y};
+        const size_t count = m_posX.size();
+
+        size_t contacts = 0;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Collision::OrientedBox box = Collision::carBox({m_posX[i], m_posY[i]}, m_rotation[i], p.size, offset);
+            const Vector2 center = box.center;
+            Vector2 vel = {m_velX[i], m_velY[i]};
+
+            const int carContacts = Collision::resolveMovingBox(colMap, box, Vector2Scale(vel, dt), vel, p.wallResponse, m_solidCells);
+            if (carContacts == 0) continue;
+
+            contacts += carContacts;
+            m_posX[i] += box.center.x - center.x;
+            m_posY[i] += box.center.y - center.y;
+            m_velX[i] = vel.x;
+            m_velY[i] = vel.y;
+        }
+
+        return contacts;
+    }
+
+    // separate cars that overlap each other, pairs come from the grid broadphase
+    // returns the number of contacts
+
+    size_t resolveCarCollisions(Collision::CarGrid& grid)
+    {
+        const CarParams p = m_params;
+        const Vector2 offset = {0.5f * p.size.x, 0.8f * p.size.y};
+        const size_t count = m_posX.size();
+
+        m_boxes.resize(count);
+        m_boxVels.resize(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_boxes[i] = Collision::carBox({m_posX[i], m_posY[i]}, m_rotation[i], p.size, offset);
+            m_boxVels[i] = {m_velX[i], m_velY[i]};
+        }
+
+        m_boxCenters.resize(count);
+        for (size_t i = 0; i < count; ++i) m_boxCenters[i] = m_boxes[i].center;
+
+        const size_t contacts = Collision::resolveBoxes(grid, m_boxes, m_boxVels, p.wallResponse);
+
+        // the position moves with the box center
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_posX[i] += m_boxes[i].center.x - m_boxCenters[i].x;
+            m_posY[i] += m_boxes[i].center.y - m_boxCenters[i].y;
+            m_velX[i] = m_boxVels[i].x;
+            m_velY[i] = m_boxVels[i].y;
+        }
+
+        return contacts;
+    }
+
+    size_t size() const {return m_posX.size();}
+
+    const Rectangle getCarAABB(size_t i) const 
+    {
+        return {m_minX[i], m_minY[i], m_maxX[i] - m_minX[i], m_maxY[i] - m_minY[i]};
+    }
+
+    const float getBoostLevel(size_t i) const {return m_boostLevel[i];}
+    const float getRotation(size_t i) const {return m_rotation[i];}
+
+    const Vector2 getVel(size_t i) const {return {m_velX[i], m_velY[i]};}
+    const Vector2 getPos(size_t i) const {return {m_posX[i], m_posY[i]};}
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace Map
+{
+    // bounding box of changed cells in cell coordinates, max is inclusive
+
+    struct DirtyRegion
+    {
+        int minX{0};
+        int minY{0};
+        int maxX{-1};
+        int maxY{-1};
+
+        bool empty() const {return maxX < minX || maxY < minY;}
+
+        void add(int x, int y)
+        {
+            if (empty())
+            {
+                minX = maxX = x;
+                minY = maxY = y;
+                return;
+            }
+            minX = std::min(minX, x);
+            minY = std::min(minY, y);
+            maxX = std::max(maxX, x);
+            maxY = std::max(maxY, y);
+        }
+
+        void add(const DirtyRegion& other)
+        {
+            if (other.empty()) return;
+            add(other.minX, other.minY);
+            add(other.maxX, other.maxY);
+        }
+
+        // closer than gap cells on both axes, or overlapping
+
+        bool near(const DirtyRegion& other, int gap) const
+        {
+            return other.minX - maxX <= gap && minX - other.maxX <= gap &&
+                   other.minY - maxY <= gap && minY - other.maxY <= gap;
+        }
+    };
+
+    // changes since a subscriber took them last, all is set after a whole layer was replaced
+
+    struct ChangeSet
+    {
+        bool all{false};
+        DirtyRegion region;
+        std::vector<int> indices;
+
+        bool empty() const {return !all && indices.empty();}
+    };
+
+    // records changed cells of one map layer, every subscriber (render cache, save, ...) gets its own
+    // list of changed indices without duplicates, so consumers only touch what changed
+
+    class ChangeTracker
+    {
+    private:
+        // queued has one bit per cell, set while the cell is in changes.indices
+
+        struct Subscriber
+        {
+            ChangeSet changes;
+            std::vector<uint64_t> queued;
+        };
+
+        size_t queuedWords() const {return ((size_t)m_width * m_height + 63) / 64;}
+
+        int m_width{0};
+        int m_height{0};
+
+        std::vector<Subscriber> m_subscribers;
+
+    public:
+        ChangeTracker() = default;
+
+        ChangeTracker(int width, int height)
+            : m_width(width)
+            , m_height(height)
+        {}
+
+        ~ChangeTracker() = default;
+
+        // new layer size, every subscriber has to take everything again
+
+        void resize(int width, int height)
+        {
+            m_width = width;
+            m_height = height;
+
+            for (auto& subscriber : m_subscribers)
+            {
+                subscriber.queued.assign(queuedWords(), 0);
+                subscriber.changes.indices.clear();
+                subscriber.changes.region = DirtyRegion();
+                subscriber.changes.all = true;
+            }
+        }
+
+        // returns the id to take changes with, a new subscriber starts with everything changed
+
+        int subscribe()
+        {
+            Subscriber subscriber;
+            subscriber.queued.assign(queuedWords(), 0);
+            subscriber.changes.all = true;
+            m_subscribers.push_back(std::move(subscriber));
+            return (int)m_subscribers.size() - 1;
+        }
+
+        void markDirty(int index)
+        {
+            if (index < 0 || index >= m_width * m_height) return;
+
+            const uint64_t bit = uint64_t(1) << (index & 63);
+
+            for (auto& subscriber : m_subscribers)
+            {
+                uint64_t& word = subscriber.queued[index >> 6];
+                if (subscriber.changes.all || (word & bit)) continue;
+
+                word |= bit;
+                subscriber.changes.indices.push_back(index);
+                subscriber.changes.region.add(index % m_width, index / m_width);
+            }
+        }
+
+        // move the changes of a subscriber into out, the vectors are swapped so their memory is reused
+
+        void take(int id, ChangeSet& out)
+        {
+            Subscriber& subscriber = m_subscribers[id];
+
+            for (int index : subscriber.changes.indices) subscriber.queued[index >> 6] &= ~(uint64_t(1) << (index & 63));
+
+            out.indices.clear();
+            std::swap(out.indices, subscriber.changes.indices);
+            out.all = subscriber.changes.all;
+            out.region = subscriber.changes.region;
+
+            subscriber.changes.all = false;
+            subscriber.changes.region = DirtyRegion();
+        }
+
+        bool hasChanges(int id) const {return !m_subscribers[id].changes.empty();}
+
+        int width() const {return m_width;}
+        int height() const {return m_height;}
+    };
+}
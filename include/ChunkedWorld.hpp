@@ -0,0 +1,561 @@
+#pragma once
+
+#include <raylib.h>
+
+#include "TileMap.hpp"
+#include "CollisionMap.hpp"
+#include "MappedFile.hpp"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+
+namespace Map
+{
+    // streamed world file (.rgw), little endian: header, table with one file offset per chunk (0 = empty chunk),
+    // then the chunks, each with one byte per tile and one bit per collision cell (row major, lowest bit first)
+    // empty chunks are not stored, so huge sparse tracks stay small on disk
+
+    constexpr char worldMagic[4] = {'R', 'G', 'W', 'D'};
+    constexpr uint32_t worldVersion = 1;
+
+    struct WorldHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t mapWidth;
+        uint32_t mapHeight;
+        uint32_t chunkSize;
+        uint32_t chunksX;
+        uint32_t chunksY;
+        uint32_t reserved;
+        uint64_t tableOffset;
+    };
+
+    static_assert(sizeof(WorldHeader) == 40, "WorldHeader must not have padding");
+
+    // in memory the collision bits are 64 bit words and every chunk row starts at a new word, like CollisionMap
+
+    struct WorldChunk
+    {
+        std::vector<uint8_t> tiles;
+        std::vector<uint64_t> collision;
+    };
+
+    // write a world file chunk by chunk, the whole map is never in memory
+    // cell returns the tile type and the collision of one cell
+
+    inline void writeWorld(const std::string& path, uint32_t mapWidth, uint32_t mapHeight, uint32_t chunkSize,
+                           const std::function<void(uint32_t x, uint32_t y, TileType& type, bool& collision)>& cell)
+    {
+        if (chunkSize == 0 || chunkSize % 8 != 0) throw std::runtime_error("writeWorld: chunk size has to be a multiple of 8!");
+
+        WorldHeader header{};
+        std::memcpy(header.magic, worldMagic, sizeof(header.magic));
+        header.version = worldVersion;
+        header.mapWidth = mapWidth;
+        header.mapHeight = mapHeight;
+        header.chunkSize = chunkSize;
+        header.chunksX = (mapWidth + chunkSize - 1) / chunkSize;
+        header.chunksY = (mapHeight + chunkSize - 1) / chunkSize;
+        header.tableOffset = sizeof(header);
+
+        std::vector<uint64_t> table ((size_t)header.chunksX * header.chunksY, 0);
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::runtime_error("writeWorld: File " + path + " couldnt open!");
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(uint64_t));
+
+        uint64_t offset = sizeof(header) + table.size() * sizeof(uint64_t);
+
+        std::vector<uint8_t> tiles (chunkSize * chunkSize);
+        std::vector<uint8_t> collision (chunkSize * chunkSize / 8);
+
+        for (uint32_t chunkY = 0; chunkY < header.chunksY; ++chunkY)
+        {
+            for (uint32_t chunkX = 0; chunkX < header.chunksX; ++chunkX)
+            {
+                std::fill(tiles.begin(), tiles.end(), 0);
+                std::fill(collision.begin(), collision.end(), 0);
+                bool empty = true;
+
+                for (uint32_t y = 0; y < chunkSize; ++y)
+                {
+                    for (uint32_t x = 0; x < chunkSize; ++x)
+                    {
+                        const uint32_t worldX = chunkX * chunkSize + x;
+                        const uint32_t worldY = chunkY * chunkSize + y;
+                        if (worldX >= mapWidth || worldY >= mapHeight) continue;
+
+                        TileType type = TileType::NONE;
+                        bool solid = false;
+                        cell(worldX, worldY, type, solid);
+
+                        const uint32_t i = y * chunkSize + x;
+                        tiles[i] = (uint8_t)type;
+                        if (solid) collision[i >> 3] |= (uint8_t)(1 << (i & 7));
+                        if (type != TileType::NONE || solid) empty = false;
+                    }
+                }
+
+                if (empty) continue;
+
+                table[(size_t)chunkY * header.chunksX + chunkX] = offset;
+                file.write(reinterpret_cast<const char*>(tiles.data()), tiles.size());
+                file.write(reinterpret_cast<const char*>(collision.data()), collision.size());
+                offset += tiles.size() + collision.size();
+            }
+        }
+
+        file.seekp(header.tableOffset);
+        file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(uint64_t));
+
+        if (!file) throw std::runtime_error("writeWorld: writing " + path + " failed!");
+    }
+
+    // world made of chunks, only chunks near the focus points (camera, cars) stay in memory
+    // a worker thread reads chunks from the mapped file, the main thread swaps them in with updateResidency
+    // the world is read only, it has the collision queries of CollisionMap so cars drive on it with Collision
+    // and the ai, cells that arent resident yet are solid, a car never drives through a wall that isnt loaded
+
+    class ChunkedWorld
+    {
+    private:
+        std::unique_ptr<MappedFile> m_file;
+        WorldHeader m_header{};
+
+        int m_tileWidth;
+        int m_tileHeight;
+
+        // only touched by the main thread
+
+        std::unordered_map<int64_t, std::unique_ptr<WorldChunk>> m_resident;
+        std::unordered_set<int64_t> m_wanted;
+        std::unordered_set<int64_t> m_pending;
+
+        // shared with the worker
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::condition_variable m_loadedCondition;
+        std::deque<int64_t> m_requests;
+        std::vector<std::pair<int64_t, std::unique_ptr<WorldChunk>>> m_loaded;
+        bool m_stop{false};
+
+        std::thread m_worker;
+
+        std::atomic<size_t> m_chunksRead{0};
+
+        size_t chunkBytes() const {return (size_t)m_header.chunkSize * m_header.chunkSize * 9 / 8;}
+
+        int wordsPerRow() const {return ((int)m_header.chunkSize + 63) / 64;}
+
+        uint64_t chunkOffset(int64_t key) const
+        {
+            uint64_t offset;
+            std::memcpy(&offset, m_file->data() + m_header.tableOffset + key * sizeof(uint64_t), sizeof(offset));
+            return offset;
+        }
+
+        // runs on the worker: copy the chunk out of the mapped file, this is where the disk is read
+
+        std::unique_ptr<WorldChunk> readChunk(int64_t key) const
+        {
+            const size_t cells = (size_t)m_header.chunkSize * m_header.chunkSize;
+
+            auto chunk = std::make_unique<WorldChunk>();
+            chunk->tiles.assign(cells, 0);
+            chunk->collision.assign((size_t)m_header.chunkSize * wordsPerRow(), 0);
+
+            const uint64_t offset = chunkOffset(key);
+            if (offset != 0)
+            {
+                std::memcpy(chunk->tiles.data(), m_file->data() + offset, cells);
+
+                // the file rows are packed bytes, chunkSize is a multiple of 8 so every row starts at a byte
+
+                const uint8_t* bits = m_file->data() + offset + cells;
+                const int rowBytes = (int)m_header.chunkSize / 8;
+                for (int y = 0; y < (int)m_header.chunkSize; ++y)
+                {
+                    uint64_t* row = &chunk->collision[(size_t)y * wordsPerRow()];
+                    for (int b = 0; b < rowBytes; ++b) row[b >> 3] |= (uint64_t)bits[(size_t)y * rowBytes + b] << ((b & 7) * 8);
+                }
+            }
+
+            return chunk;
+        }
+
+        void workerLoop()
+        {
+            while (true)
+            {
+                int64_t key;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_condition.wait(lock, [this] {return m_stop || !m_requests.empty();});
+                    if (m_stop) return;
+                    key = m_requests.front();
+                    m_requests.pop_front();
+                }
+
+                std::unique_ptr<WorldChunk> chunk = readChunk(key);
+                m_chunksRead++;
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_loaded.emplace_back(key, std::move(chunk));
+                }
+                m_loadedCondition.notify_all();
+            }
+        }
+
+        const WorldChunk* findChunk(int64_t tileX, int64_t tileY, int& local) const
+        {
+            const int64_t size = m_header.chunkSize;
+            auto it = m_resident.find((tileY / size) * m_header.chunksX + tileX / size);
+            if (it == m_resident.end()) return nullptr;
+
+            local = (int)((tileY % size) * size + tileX % size);
+            return it->second.get();
+        }
+
+        // calls visit for every chunk a cell range overlaps with one lookup per chunk, chunk is null when it is not resident
+        // visit gets the first cell of the chunk and the range clipped to the chunk in local cells, it returns true to stop
+
+        template<typename Visit>
+        bool forChunks(int64_t minX, int64_t minY, int64_t maxX, int64_t maxY, Visit&& visit) const
+        {
+            const int64_t size = m_header.chunkSize;
+
+            for (int64_t chunkY = minY / size; chunkY <= maxY / size; ++chunkY)
+            {
+                const int64_t originY = chunkY * size;
+                const int fromY = (int)(std::max(minY, originY) - originY);
+                const int toY = (int)(std::min(maxY, originY + size - 1) - originY);
+
+                for (int64_t chunkX = minX / size; chunkX <= maxX / size; ++chunkX)
+                {
+                    const int64_t originX = chunkX * size;
+                    const int fromX = (int)(std::max(minX, originX) - originX);
+                    const int toX = (int)(std::min(maxX, originX + size - 1) - originX);
+
+                    auto it = m_resident.find(chunkY * m_header.chunksX + chunkX);
+                    const WorldChunk* chunk = it != m_resident.end() ? it->second.get() : nullptr;
+
+                    if (visit(chunk, originX, originY, fromX, fromY, toX, toY)) return true;
+                }
+            }
+            return false;
+        }
+
+        // cells touched by a rectangle in world coordinates, false when it is outside the map
+
+        bool cellRange(Rectangle rect, int64_t& minX, int64_t& minY, int64_t& maxX, int64_t& maxY) const
+        {
+            const double fromX = floor((double)rect.x / m_tileWidth);
+            const double fromY = floor((double)rect.y / m_tileHeight);
+            const double toX = floor((double)(rect.x + rect.width) / m_tileWidth);
+            const double toY = floor((double)(rect.y + rect.height) / m_tileHeight);
+
+            if (toX < 0.0 || toY < 0.0 || fromX >= m_header.mapWidth || fromY >= m_header.mapHeight) return false;
+
+            minX = (int64_t)std::max(fromX, 0.0);
+            minY = (int64_t)std::max(fromY, 0.0);
+            maxX = (int64_t)std::min(toX, (double)m_header.mapWidth - 1);
+            maxY = (int64_t)std::min(toY, (double)m_header.mapHeight - 1);
+            return true;
+        }
+
+    public:
+        using Index = int64_t;
+
+        ChunkedWorld(const std::string& path, int tileWidth, int tileHeight)
+            : m_tileWidth(tileWidth)
+            , m_tileHeight(tileHeight)
+        {
+            m_file = std::make_unique<MappedFile>(path);
+
+            if (m_file->size() < sizeof(m_header)) throw std::runtime_error("ChunkedWorld: file " + path + " is too small for a world header!");
+            std::memcpy(&m_header, m_file->data(), sizeof(m_header));
+
+            if (std::memcmp(m_header.magic, worldMagic, sizeof(worldMagic)) != 0) throw std::runtime_error("ChunkedWorld: file " + path + " is no world!");
+            if (m_header.version != worldVersion) throw std::runtime_error("ChunkedWorld: unsupported world version " + std::to_string(m_header.version) + "!");
+            if (m_header.chunkSize == 0 || m_header.chunkSize % 8 != 0) throw std::runtime_error("ChunkedWorld: invalid chunk size!");
+
+            // offset + size could wrap around, so sizes are checked against what is left after the offset
+
+            const uint64_t fileSize = m_file->size();
+            const uint64_t chunkCount = (uint64_t)m_header.chunksX * m_header.chunksY;
+            if (m_header.tableOffset > fileSize || chunkCount > (fileSize - m_header.tableOffset) / sizeof(uint64_t))
+            {
+                throw std::runtime_error("ChunkedWorld: file " + path + " is truncated!");
+            }
+
+            for (uint64_t key = 0; key < chunkCount; ++key)
+            {
+                uint64_t offset = chunkOffset((int64_t)key);
+                if (offset != 0 && (offset > fileSize || chunkBytes() > fileSize - offset))
+                {
+                    throw std::runtime_error("ChunkedWorld: file " + path + " is truncated!");
+                }
+            }
+
+            m_worker = std::thread(&ChunkedWorld::workerLoop, this);
+        }
+
+        ~ChunkedWorld()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_condition.notify_all();
+            m_worker.join();
+        }
+
+        ChunkedWorld(const ChunkedWorld&) = delete;
+        ChunkedWorld& operator=(const ChunkedWorld&) = delete;
+
+        // keep every chunk within radius (world px) of a focus point, request missing ones and drop the rest
+        // loaded chunks are swapped in here, so queries never see a chunk the worker is still writing
+
+        void updateResidency(const std::vector<Vector2>& focusPoints, float radius)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (auto& [key, chunk] : m_loaded)
+                {
+                    m_pending.erase(key);
+                    if (m_wanted.count(key)) m_resident[key] = std::move(chunk);
+                }
+                m_loaded.clear();
+            }
+
+            const float chunkWorldWidth = (float)(m_header.chunkSize * m_tileWidth);
+            const float chunkWorldHeight = (float)(m_header.chunkSize * m_tileHeight);
+
+            m_wanted.clear();
+
+            for (const Vector2& point : focusPoints)
+            {
+                const int64_t minX = std::max<int64_t>((int64_t)floorf((point.x - radius) / chunkWorldWidth), 0);
+                const int64_t minY = std::max<int64_t>((int64_t)floorf((point.y - radius) / chunkWorldHeight), 0);
+                const int64_t maxX = std::min<int64_t>((int64_t)floorf((point.x + radius) / chunkWorldWidth), (int64_t)m_header.chunksX - 1);
+                const int64_t maxY = std::min<int64_t>((int64_t)floorf((point.y + radius) / chunkWorldHeight), (int64_t)m_header.chunksY - 1);
+
+                for (int64_t y = minY; y <= maxY; ++y)
+                {
+                    for (int64_t x = minX; x <= maxX; ++x) m_wanted.insert(y * m_header.chunksX + x);
+                }
+            }
+
+            for (auto it = m_resident.begin(); it != m_resident.end();)
+            {
+                if (m_wanted.count(it->first)) ++it;
+                else it = m_resident.erase(it);
+            }
+
+            bool requested = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                // requests the focus moved away from are dropped before the worker reads them
+
+                for (auto it = m_requests.begin(); it != m_requests.end();)
+                {
+                    if (m_wanted.count(*it)) ++it;
+                    else
+                    {
+                        m_pending.erase(*it);
+                        it = m_requests.erase(it);
+                    }
+                }
+
+                for (int64_t key : m_wanted)
+                {
+                    if (m_resident.count(key) || m_pending.count(key)) continue;
+                    m_pending.insert(key);
+                    m_requests.push_back(key);
+                    requested = true;
+                }
+            }
+            if (requested) m_condition.notify_one();
+        }
+
+        // updateResidency, then block until every chunk around the focus points is resident
+        // for the start of a race or a jump, where the cars would otherwise stand in unloaded (solid) cells
+
+        void loadAround(const std::vector<Vector2>& focusPoints, float radius)
+        {
+            updateResidency(focusPoints, radius);
+
+            while (!m_pending.empty())
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_loadedCondition.wait(lock, [this] {return !m_loaded.empty();});
+                }
+                updateResidency(focusPoints, radius);
+            }
+        }
+
+        // same queries as TileMap and CollisionMap, with 64 bit indices
+        // a cell outside of the map is free like in CollisionMap, a cell of a chunk that isnt resident is solid
+
+        int64_t getIndexTilePos(int64_t tileX, int64_t tileY) const
+        {
+            if (tileX < 0 || tileY < 0 || tileX >= m_header.mapWidth || tileY >= m_header.mapHeight) return -1;
+            return tileY * m_header.mapWidth + tileX;
+        }
+
+        int64_t getIndexWorldPos(Vector2 worldPos) const
+        {
+            return getIndexTilePos((int64_t)floorf(worldPos.x / (float)m_tileWidth), (int64_t)floorf(worldPos.y / (float)m_tileHeight));
+        }
+
+        Vector2 getWorldPos(int64_t index) const
+        {
+            return {(float)(index % m_header.mapWidth) * m_tileWidth, (float)(index / m_header.mapWidth) * m_tileHeight};
+        }
+
+        bool isResident(int64_t index) const
+        {
+            int local;
+            return indexValid(index) && findChunk(index % m_header.mapWidth, index / m_header.mapWidth, local);
+        }
+
+        TileType getTile(int64_t index) const
+        {
+            int local;
+            if (!indexValid(index)) return TileType::NONE;
+            const WorldChunk* chunk = findChunk(index % m_header.mapWidth, index / m_header.mapWidth, local);
+            return chunk ? static_cast<TileType>(chunk->tiles[local]) : TileType::NONE;
+        }
+
+        bool isSolid(int64_t index) const
+        {
+            int local;
+            if (!indexValid(index)) return false;
+            const WorldChunk* chunk = findChunk(index % m_header.mapWidth, index / m_header.mapWidth, local);
+            if (!chunk) return true;
+
+            const int size = (int)m_header.chunkSize;
+            const int x = local % size;
+            return (chunk->collision[(size_t)(local / size) * wordsPerRow() + (x >> 6)] >> (x & 63)) & 1;
+        }
+
+        std::optional<Rectangle> getRect(int64_t index) const
+        {
+            if (!isSolid(index)) return std::nullopt;
+
+            Vector2 pos = getWorldPos(index);
+            return Rectangle{pos.x, pos.y, (float)m_tileWidth, (float)m_tileHeight};
+        }
+
+        // queries on a rectangle in world coordinates, each chunk it overlaps is looked up once
+        // and its rows are scanned a word at a time, cells of chunks that are not resident are solid
+
+        bool anySolid(Rectangle rect) const
+        {
+            int64_t minX, minY, maxX, maxY;
+            if (!cellRange(rect, minX, minY, maxX, maxY)) return false;
+
+            return forChunks(minX, minY, maxX, maxY, [&](const WorldChunk* chunk, int64_t, int64_t, int fromX, int fromY, int toX, int toY)
+            {
+                if (!chunk) return true;
+
+                for (int y = fromY; y <= toY; ++y)
+                {
+                    const uint64_t* row = &chunk->collision[(size_t)y * wordsPerRow()];
+                    for (int wordX = fromX >> 6; wordX <= toX >> 6; ++wordX)
+                    {
+                        if (row[wordX] & CollisionMap::spanMask(wordX, fromX, toX)) return true;
+                    }
+                }
+                return false;
+            });
+        }
+
+        // appends the indices of the solid cells, row by row like CollisionMap
+
+        void solidCells(Rectangle rect, std::vector<int64_t>& out) const
+        {
+            int64_t minX, minY, maxX, maxY;
+            if (!cellRange(rect, minX, minY, maxX, maxY)) return;
+
+            const size_t first = out.size();
+            const int64_t mapWidth = m_header.mapWidth;
+
+            forChunks(minX, minY, maxX, maxY, [&](const WorldChunk* chunk, int64_t originX, int64_t originY, int fromX, int fromY, int toX, int toY)
+            {
+                for (int y = fromY; y <= toY; ++y)
+                {
+                    const int64_t rowIndex = (originY + y) * mapWidth + originX;
+
+                    if (!chunk)
+                    {
+                        for (int x = fromX; x <= toX; ++x) out.push_back(rowIndex + x);
+                        continue;
+                    }
+
+                    const uint64_t* row = &chunk->collision[(size_t)y * wordsPerRow()];
+                    for (int wordX = fromX >> 6; wordX <= toX >> 6; ++wordX)
+                    {
+                        uint64_t bits = row[wordX] & CollisionMap::spanMask(wordX, fromX, toX);
+                        while (bits)
+                        {
+                            out.push_back(rowIndex + wordX * 64 + std::countr_zero(bits));
+                            bits &= bits - 1;
+                        }
+                    }
+                }
+                return false;
+            });
+
+            // chunk by chunk is not row by row when the rectangle spans chunk columns, row major is ascending indices
+
+            const int64_t size = m_header.chunkSize;
+            if (minX / size != maxX / size) std::sort(out.begin() + first, out.end());
+        }
+
+        // there is no distance field, Collision and the ai fall back to scanning the cells
+
+        bool hasDistanceField() const {return false;}
+        float distanceToSolid(int64_t) const {return 0.f;}
+        float distanceToSolid(Vector2) const {return 0.f;}
+
+        bool indexValid(int64_t index) const
+        {
+            return index >= 0 && index < (int64_t)m_header.mapWidth * m_header.mapHeight;
+        }
+
+        int64_t width() const {return m_header.mapWidth;}
+        int64_t height() const {return m_header.mapHeight;}
+
+        int rectWidth() const {return m_tileWidth;}
+        int rectHeight() const {return m_tileHeight;}
+
+        size_t residentChunks() const {return m_resident.size();}
+        size_t pendingChunks() const {return m_pending.size();}
+        size_t chunksRead() const {return m_chunksRead;}
+        size_t residentBytes() const {return m_resident.size() * ((size_t)m_header.chunkSize * m_header.chunkSize + (size_t)m_header.chunkSize * wordsPerRow() * 8);}
+    };
+}
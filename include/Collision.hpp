@@ -0,0 +1,340 @@
+#pragma once
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "CollisionMap.hpp"
+
+#include <vector>
+#include <cmath>
+
+namespace Collision
+{
+    // car box, axisX points sideways and axisY forward (both normalized), halfSize along those axes
+
+    struct OrientedBox
+    {
+        Vector2 center;
+        Vector2 axisX;
+        Vector2 axisY;
+        Vector2 halfSize;
+    };
+
+    // box of a car with its rotation pivot at offset from the back left corner, like Car::getCarAABB
+
+    inline OrientedBox carBox(Vector2 pos, float rotation, Vector2 size, Vector2 offset)
+    {
+        const float rad = rotation * (PI / 180.f);
+        const Vector2 forward = {sinf(rad), -cosf(rad)};
+        const Vector2 sideways = {-forward.y, forward.x};
+
+        OrientedBox box;
+        box.center = Vector2Add(pos, Vector2Scale(forward, offset.y - size.y * 0.5f));
+        box.axisX = sideways;
+        box.axisY = forward;
+        box.halfSize = Vector2Scale(size, 0.5f);
+        return box;
+    }
+
+    inline Rectangle boundingRect(const OrientedBox& box)
+    {
+        const float extentX = fabsf(box.axisX.x) * box.halfSize.x + fabsf(box.axisY.x) * box.halfSize.y;
+        const float extentY = fabsf(box.axisX.y) * box.halfSize.x + fabsf(box.axisY.y) * box.halfSize.y;
+        return {box.center.x - extentX, box.center.y - extentY, extentX * 2.f, extentY * 2.f};
+    }
+
+    // faces of a cell that border a free cell, contacts are only pushed out through those
+    // so a car sliding along a wall doesnt catch on the seams between its cells
+
+    enum Face : uint8_t
+    {
+        FACE_LEFT = 1,
+        FACE_RIGHT = 2,
+        FACE_TOP = 4,
+        FACE_BOTTOM = 8
+    };
+
+    // separating axis test of a box against a cell, on overlap normal points from the cell to the box
+    // and depth is how far the box has to move along it, axes of closed faces are skipped
+
+    inline bool boxVsCell(const OrientedBox& box, Rectangle cell, uint8_t openFaces, Vector2& normal, float& depth)
+    {
+        if (!openFaces) return false;
+
+        const Vector2 cellHalf = {cell.width * 0.5f, cell.height * 0.5f};
+        const Vector2 delta = Vector2Subtract(box.center, {cell.x + cellHalf.x, cell.y + cellHalf.y});
+
+        depth = INFINITY;
+
+        // world axes of the cell
+
+        const float boxExtentX = fabsf(box.axisX.x) * box.halfSize.x + fabsf(box.axisY.x) * box.halfSize.y;
+        const float boxExtentY = fabsf(box.axisX.y) * box.halfSize.x + fabsf(box.axisY.y) * box.halfSize.y;
+
+        const float overlapX = boxExtentX + cellHalf.x - fabsf(delta.x);
+        const float overlapY = boxExtentY + cellHalf.y - fabsf(delta.y);
+        if (overlapX <= 0.f || overlapY <= 0.f) return false;
+
+        if (openFaces & (delta.x < 0.f ? FACE_LEFT : FACE_RIGHT))
+        {
+            depth = overlapX;
+            normal = {delta.x < 0.f ? -1.f : 1.f, 0.f};
+        }
+        if ((openFaces & (delta.y < 0.f ? FACE_TOP : FACE_BOTTOM)) && overlapY < depth)
+        {
+            depth = overlapY;
+            normal = {0.f, delta.y < 0.f ? -1.f : 1.f};
+        }
+
+        // axes of the box, only used when they point out of an open face
+
+        const Vector2 axes[2] = {box.axisX, box.axisY};
+
+        for (int i = 0; i < 2; ++i)
+        {
+            const Vector2 axis = axes[i];
+            const float cellExtent = fabsf(axis.x) * cellHalf.x + fabsf(axis.y) * cellHalf.y;
+            const float distance = Vector2DotProduct(delta, axis);
+            const float overlap = (i == 0 ? box.halfSize.x : box.halfSize.y) + cellExtent - fabsf(distance);
+            if (overlap <= 0.f) return false;
+
+            const Vector2 axisNormal = distance < 0.f ? Vector2Negate(axis) : axis;
+            const bool open = ((openFaces & FACE_LEFT) && axisNormal.x < 0.f) || ((openFaces & FACE_RIGHT) && axisNormal.x > 0.f) ||
+                              ((openFaces & FACE_TOP) && axisNormal.y < 0.f) || ((openFaces & FACE_BOTTOM) && axisNormal.y > 0.f);
+
+            if (open && overlap < depth)
+            {
+                depth = overlap;
+                normal = axisNormal;
+            }
+        }
+
+        return depth != INFINITY;
+    }
+
+    template <typename Grid>
+    inline uint8_t openFaces(const Grid& map, typename Grid::Index index)
+    {
+        const auto x = index % map.width();
+        const auto y = index / map.width();
+
+        uint8_t faces = 0;
+        if (x == 0 || !map.isSolid(index - 1)) faces |= FACE_LEFT;
+        if (x == map.width() - 1 || !map.isSolid(index + 1)) faces |= FACE_RIGHT;
+        if (y == 0 || !map.isSolid(index - map.width())) faces |= FACE_TOP;
+        if (y == map.height() - 1 || !map.isSolid(index + map.width())) faces |= FACE_BOTTOM;
+        return faces;
+    }
+
+    // sweep the bounding rectangle of a box along displacement and find the first solid cell it hits
+    // walks the cells under the box center with a DDA, every step only checks the cells the box can touch
+    // from there, so the cost follows the number of cells crossed and not the speed
+    // toi is the fraction of displacement before the hit, contacts the box already has at the start are ignored
+
+    template <typename Grid>
+    inline bool sweepBox(const Grid& map, const OrientedBox& box, Vector2 displacement, 
+                         float& toi, Vector2& normal, std::vector<typename Grid::Index>& cells)
+    {
+        const Rectangle bounds = boundingRect(box);
+        const Vector2 extent = {bounds.width * 0.5f, bounds.height * 0.5f};
+        const Vector2 origin = box.center;
+
+        const float cellWidth = (float)map.rectWidth();
+        const float cellHeight = (float)map.rectHeight();
+
+        int cellX = (int)floorf(origin.x / cellWidth);
+        int cellY = (int)floorf(origin.y / cellHeight);
+
+        const int stepX = displacement.x > 0.f ? 1 : -1;
+        const int stepY = displacement.y > 0.f ? 1 : -1;
+
+        float nextX = displacement.x != 0.f ? ((cellX + (stepX > 0)) * cellWidth - origin.x) / displacement.x : INFINITY;
+        float nextY = displacement.y != 0.f ? ((cellY + (stepY > 0)) * cellHeight - origin.y) / displacement.y : INFINITY;
+        const float deltaX = displacement.x != 0.f ? cellWidth / fabsf(displacement.x) : INFINITY;
+        const float deltaY = displacement.y != 0.f ? cellHeight / fabsf(displacement.y) : INFINITY;
+
+        toi = INFINITY;
+
+        while (true)
+        {
+            // cells the box touches while its center is in this cell
+
+            const Rectangle band = {cellX * cellWidth - extent.x, cellY * cellHeight - extent.y, 
+                                    cellWidth + extent.x * 2.f, cellHeight + extent.y * 2.f};
+
+            if (map.anySolid(band))
+            {
+                cells.clear();
+                map.solidCells(band, cells);
+
+                for (const auto index : cells)
+                {
+                    const Vector2 cellPos = map.getWorldPos(index);
+
+                    // ray of the center against the cell grown by the box extent
+
+                    const float x0 = (cellPos.x - extent.x - origin.x) / displacement.x;
+                    const float x1 = (cellPos.x + cellWidth + extent.x - origin.x) / displacement.x;
+                    const float y0 = (cellPos.y - extent.y - origin.y) / displacement.y;
+                    const float y1 = (cellPos.y + cellHeight + extent.y - origin.y) / displacement.y;
+
+                    const float enterX = displacement.x != 0.f ? fminf(x0, x1) : (fabsf(origin.x - cellPos.x - cellWidth * 0.5f) < cellWidth * 0.5f + extent.x ? -INFINITY : INFINITY);
+                    const float exitX = displacement.x != 0.f ? fmaxf(x0, x1) : INFINITY;
+                    const float enterY = displacement.y != 0.f ? fminf(y0, y1) : (fabsf(origin.y - cellPos.y - cellHeight * 0.5f) < cellHeight * 0.5f + extent.y ? -INFINITY : INFINITY);
+                    const float exitY = displacement.y != 0.f ? fmaxf(y0, y1) : INFINITY;
+
+                    const float enter = fmaxf(enterX, enterY);
+                    const float exit = fminf(exitX, exitY);
+
+                    if (enter > exit || enter < 0.f || enter > 1.f || enter >= toi) continue;
+
+                    // only faces next to free cells stop the box
+
+                    const uint8_t faces = openFaces(map, index);
+                    Vector2 hitNormal;
+                    uint8_t face;
+
+                    if (enterX > enterY)
+                    {
+                        hitNormal = {(float)-stepX, 0.f};
+                        face = stepX > 0 ? FACE_LEFT : FACE_RIGHT;
+                    }
+                    else
+                    {
+                        hitNormal = {0.f, (float)-stepY};
+                        face = stepY > 0 ? FACE_TOP : FACE_BOTTOM;
+                    }
+
+                    if (!(faces & face)) continue;
+
+                    toi = enter;
+                    normal = hitNormal;
+                }
+            }
+
+            // a hit before the center leaves this cell is the first one
+
+            const float leave = fminf(nextX, nextY);
+            if (toi <= leave || leave > 1.f) break;
+
+            if (nextX < nextY)
+            {
+                cellX += stepX;
+                nextX += deltaX;
+            }
+            else
+            {
+                cellY += stepY;
+                nextY += deltaY;
+            }
+        }
+
+        return toi <= 1.f;
+    }
+
+    // friction is the coulomb coefficient, the sliding speed a contact takes away is at most friction times
+    // the change of the speed along the normal, so the loss follows the impacts and not the number of ticks
+
+    struct Response
+    {
+        float friction{0.2f};
+        float restitution{0.3f};
+    };
+
+    // the part of the velocity into the wall bounces with restitution, the part along it slows down by coulomb friction
+
+    inline Vector2 reflect(Vector2 vel, Vector2 normal, Response response)
+    {
+        const float intoWall = Vector2DotProduct(vel, normal);
+        if (intoWall >= 0.f) return vel;
+
+        const Vector2 normalVel = Vector2Scale(normal, intoWall);
+        const Vector2 tangentVel = Vector2Subtract(vel, normalVel);
+
+        const float sliding = Vector2Length(tangentVel);
+        const float slowDown = fminf(sliding, response.friction * -intoWall * (1.f + response.restitution));
+        const Vector2 slidingVel = sliding > 0.f ? Vector2Scale(tangentVel, (sliding - slowDown) / sliding) : tangentVel;
+
+        return Vector2Subtract(slidingVel, Vector2Scale(normalVel, response.restitution));
+    }
+
+    // push the box out of every solid cell it overlaps and reflect the velocity on the contact normals
+    // cells is scratch memory, contacts gets the rectangle of every touched cell if set, returns the number of contacts
+    // map is a Map::CollisionMap or anything with the same queries (Map::ChunkedWorld)
+
+    template <typename Grid>
+    inline int resolveBox(const Grid& map, OrientedBox& box, Vector2& vel, Response response, std::vector<typename Grid::Index>& cells,
+                          std::vector<Rectangle>* contactRects = nullptr)
+    {
+        // with a distance field, a box whose cell is further from every wall than its size skips the scan
+        // a touched cell center is at most the box half diagonal plus a cell diagonal away from the box cell center
+
+        if (map.hasDistanceField() && map.rectWidth() == map.rectHeight())
+        {
+            const float reach = Vector2Length(box.halfSize) / (float)map.rectWidth() + 1.5f;
+            const float distance = map.distanceToSolid(map.getIndexWorldPos(box.center));
+            if (distance > reach) return 0;
+        }
+
+        const Rectangle bounds = boundingRect(box);
+        if (!map.anySolid(bounds)) return 0;
+
+        cells.clear();
+        map.solidCells(bounds, cells);
+
+        int contacts = 0;
+
+        for (const auto index : cells)
+        {
+            Vector2 normal{};
+            float depth{};
+
+            const Vector2 cellPos = map.getWorldPos(index);
+            const Rectangle cell = {cellPos.x, cellPos.y, (float)map.rectWidth(), (float)map.rectHeight()};
+
+            if (!boxVsCell(box, cell, openFaces(map, index), normal, depth)) continue;
+
+            box.center = Vector2Add(box.center, Vector2Scale(normal, depth));
+            ++contacts;
+            if (contactRects) contactRects->push_back(cell);
+
+            vel = reflect(vel, normal, response);
+        }
+
+        return contacts;
+    }
+
+    // continuous collision for a box that moved by displacement this tick, box is at the end of the move
+    // a move further than the box is thin is swept from the start, on a hit the box stops just before the wall
+    // and the velocity is reflected, then the discrete resolve cleans up, returns the number of contacts
+
+    template <typename Grid>
+    inline int resolveMovingBox(const Grid& map, OrientedBox& box, Vector2 displacement, Vector2& vel, 
+                                Response response, std::vector<typename Grid::Index>& cells, std::vector<Rectangle>* contactRects = nullptr)
+    {
+        int contacts = 0;
+
+        if (Vector2Length(displacement) > fminf(box.halfSize.x, box.halfSize.y))
+        {
+            OrientedBox start = box;
+            start.center = Vector2Subtract(box.center, displacement);
+
+            float toi;
+            Vector2 normal;
+
+            if (sweepBox(map, start, displacement, toi, normal, cells))
+            {
+                // stop a little before the wall, so the discrete step doesnt see an overlap from rounding
+
+                const float length = Vector2Length(displacement);
+                const float backOff = fminf(0.01f / length, toi);
+
+                box.center = Vector2Add(start.center, Vector2Scale(displacement, toi - backOff));
+                vel = reflect(vel, normal, response);
+                ++contacts;
+            }
+        }
+
+        return contacts + resolveBox(map, box, vel, response, cells, contactRects);
+    }
+}
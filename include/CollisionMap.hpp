@@ -2,11 +2,22 @@
 
 #include <raylib.h>
 
+#include "ChangeTracker.hpp"
+#include "DistanceField.hpp"
+
 #include <optional>
+#include <memory>
 #include <vector>
+#include <cstdint>
+#include <cmath>
+#include <bit>
+#include <algorithm>
 
 namespace Map
 {
+    // one bit per cell in 64 bit words, every row starts at a new word
+    // so a span of a row is a few masked words and rectangle queries never look at single cells
+
     class CollisionMap
     {
     private:
@@ -16,16 +27,119 @@ namespace Map
         int m_mapWidth;
         int m_mapHeight;
         
-        std::vector<bool> m_collisionMap;
+        int m_wordsPerRow{0};
+        std::vector<uint64_t> m_words;
+
+        ChangeTracker m_changes;
+
+        // optional distance field, kept up to date from its own change subscription
+
+        std::unique_ptr<DistanceField> m_distanceField;
+        int m_distanceSubscriber{-1};
+        ChangeSet m_distanceChanges;
+        std::vector<DirtyRegion> m_distanceWindows;
+
+        // changed cells grouped into windows, changes whose rebuilds would overlap share one window
+        // so edits far apart rebuild around each of them and not the box spanning all
+
+        void clusterDistanceChanges(int gap)
+        {
+            m_distanceWindows.clear();
+
+            for (int index : m_distanceChanges.indices)
+            {
+                DirtyRegion cell;
+                cell.add(index % m_mapWidth, index / m_mapWidth);
+
+                auto window = std::find_if(m_distanceWindows.begin(), m_distanceWindows.end(), [&](const DirtyRegion& w) {return w.near(cell, gap);});
+                if (window == m_distanceWindows.end())
+                {
+                    m_distanceWindows.push_back(cell);
+                    continue;
+                }
+
+                window->add(cell);
+
+                // a grown window can reach others, those are merged into it until none is left
+
+                size_t grown = window - m_distanceWindows.begin();
+                for (bool merged = true; merged;)
+                {
+                    merged = false;
+                    for (size_t i = 0; i < m_distanceWindows.size(); ++i)
+                    {
+                        if (i == grown || !m_distanceWindows[grown].near(m_distanceWindows[i], gap)) continue;
+
+                        m_distanceWindows[grown].add(m_distanceWindows[i]);
+                        m_distanceWindows[i] = m_distanceWindows.back();
+                        if (grown == m_distanceWindows.size() - 1) grown = i;
+                        m_distanceWindows.pop_back();
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        void resizeWords()
+        {
+            m_wordsPerRow = (m_mapWidth + 63) / 64;
+            m_words.assign((size_t)m_wordsPerRow * m_mapHeight, 0);
+        }
+
+        bool getBit(int x, int y) const
+        {
+            return (m_words[(size_t)y * m_wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+        }
+
+        void setBit(int x, int y, bool value)
+        {
+            uint64_t& word = m_words[(size_t)y * m_wordsPerRow + (x >> 6)];
+            const uint64_t bit = uint64_t(1) << (x & 63);
+            word = value ? (word | bit) : (word & ~bit);
+        }
+
+        // cells touched by a rectangle in world coordinates, false when it is outside the map
+
+        bool cellRange(Rectangle rect, int& minX, int& minY, int& maxX, int& maxY) const
+        {
+            const float fromX = floorf(rect.x / (float)m_rectWidth);
+            const float fromY = floorf(rect.y / (float)m_rectHeight);
+            const float toX = floorf((rect.x + rect.width) / (float)m_rectWidth);
+            const float toY = floorf((rect.y + rect.height) / (float)m_rectHeight);
+
+            if (toX < 0.f || toY < 0.f || fromX >= m_mapWidth || fromY >= m_mapHeight) return false;
+
+            minX = (int)fmaxf(fromX, 0.f);
+            minY = (int)fmaxf(fromY, 0.f);
+            maxX = (int)fminf(toX, (float)m_mapWidth - 1);
+            maxY = (int)fminf(toY, (float)m_mapHeight - 1);
+            return true;
+        }
 
     public:
+        // index type of the cells, Collision and the ai are written against these queries, ChunkedWorld has them too
+
+        using Index = int;
+
+        // bits fromX to toX (inclusive) of word wordX in a row, ChunkedWorld scans its chunk rows with it too
+
+        static uint64_t spanMask(int wordX, int fromX, int toX)
+        {
+            const int first = std::max(fromX - wordX * 64, 0);
+            const int last = std::min(toX - wordX * 64, 63);
+            const uint64_t upper = last == 63 ? ~uint64_t(0) : (uint64_t(1) << (last + 1)) - 1;
+            return upper & (~uint64_t(0) << first);
+        }
+
         CollisionMap(int rectWidth, int rectHeight, int mapWidth, int mapHeight)
             : m_rectWidth(rectWidth)
             , m_rectHeight(rectHeight)
             , m_mapWidth(mapWidth)
             , m_mapHeight(mapHeight)
         {
-            m_collisionMap = std::vector<bool> (m_mapWidth * m_mapHeight, 0);
+            resizeWords();
+            m_changes.resize(m_mapWidth, m_mapHeight);
         }
 
         void loadMap(std::vector<int> collisionMap, int mapWidth, int mapHeight)
@@ -33,12 +147,43 @@ namespace Map
             m_mapWidth = mapWidth;
             m_mapHeight = mapHeight;
 
-            m_collisionMap = std::vector<bool> (m_mapWidth * m_mapHeight, 0);
+            resizeWords();
+
+            for (int i = 0; i < m_mapWidth * m_mapHeight; ++i)
+            {
+                if (collisionMap[i]) setBit(i % m_mapWidth, i / m_mapWidth, true);
+            }
+
+            m_changes.resize(m_mapWidth, m_mapHeight);
+        }
+
+        // load from one bit per cell, row major, lowest bit first (binary map format)
+
+        void loadBits(const uint8_t* bits, int mapWidth, int mapHeight)
+        {
+            m_mapWidth = mapWidth;
+            m_mapHeight = mapHeight;
+
+            resizeWords();
 
             for (int i = 0; i < m_mapWidth * m_mapHeight; ++i)
             {
-                m_collisionMap[i] = static_cast<bool>(collisionMap[i]);
+                if ((bits[i >> 3] >> (i & 7)) & 1) setBit(i % m_mapWidth, i / m_mapWidth, true);
             }
+
+            m_changes.resize(m_mapWidth, m_mapHeight);
+        }
+
+        std::vector<uint8_t> saveBits()
+        {
+            std::vector<uint8_t> bits ((m_mapWidth * m_mapHeight + 7) / 8, 0);
+
+            for (int i = 0; i < m_mapWidth * m_mapHeight; ++i)
+            {
+                if (getBit(i % m_mapWidth, i / m_mapWidth)) bits[i >> 3] |= (uint8_t)(1 << (i & 7));
+            }
+
+            return bits;
         }
 
         std::vector<int> saveMap()
@@ -47,51 +192,51 @@ namespace Map
 
             for (int i = 0; i < m_mapWidth * m_mapHeight; ++i)
             {
-                tileMap[i] = m_collisionMap[i] ? 1 : 0;
+                tileMap[i] = getBit(i % m_mapWidth, i / m_mapWidth) ? 1 : 0;
             }
 
             return tileMap;
         }
 
-        int getIndexRectPos(Vector2 rectPos)
+        int getIndexRectPos(Vector2 rectPos) const
         {
             if (!rectPosValid(rectPos)) return -1;
             return (int)rectPos.y * m_mapWidth + (int)rectPos.x;
         }
 
-        int getIndexWorldPos(Vector2 worldPos)
+        int getIndexWorldPos(Vector2 worldPos) const
         {
             Vector2 rectPos = getRectPos(worldPos);
             return getIndexRectPos(rectPos);
         }
         
-        Vector2 getRectPos(Vector2 worldPos)
+        Vector2 getRectPos(Vector2 worldPos) const
         {
             return {floorf(worldPos.x / (float)m_rectWidth), 
                     floorf(worldPos.y / (float)m_rectHeight)};
         }
 
-        Vector2 getRectPos(int index)
+        Vector2 getRectPos(int index) const
         {
             return {(float)(index % m_mapWidth), 
                     (float)(index / m_mapWidth)};
         }
 
-        Vector2 getWorldPos(Vector2 rectPos)
+        Vector2 getWorldPos(Vector2 rectPos) const
         {
             return {rectPos.x * m_rectWidth, 
                     rectPos.y * m_rectHeight};
         }
 
-        Vector2 getWorldPos(int index)
+        Vector2 getWorldPos(int index) const
         {
             Vector2 rectPos = getRectPos(index);
             return getWorldPos(rectPos);
         }
 
-        std::optional<Rectangle> getRect(int index)
+        std::optional<Rectangle> getRect(int index) const
         {
-            if (!indexValid(index) || m_collisionMap[index] == 0) 
+            if (!isSolid(index)) 
             {
                 return std::nullopt;
             }
@@ -102,20 +247,163 @@ namespace Map
 
         void setCollision(int index, bool value)
         {
-            if (!indexValid(index)) return;
-            m_collisionMap[index] = value;
+            if (!indexValid(index) || isSolid(index) == value) return;
+            setBit(index % m_mapWidth, index / m_mapWidth, value);
+            m_changes.markDirty(index);
+        }
+
+        bool isSolid(int index) const
+        {
+            return index >= 0 && index < m_mapWidth * m_mapHeight && getBit(index % m_mapWidth, index / m_mapWidth);
+        }
+
+        // any solid cell in row y from fromX to toX (cells, inclusive)
+
+        bool anySolidInRow(int y, int fromX, int toX) const
+        {
+            if (y < 0 || y >= m_mapHeight) return false;
+            fromX = std::max(fromX, 0);
+            toX = std::min(toX, m_mapWidth - 1);
+
+            const uint64_t* row = &m_words[(size_t)y * m_wordsPerRow];
+            for (int wordX = fromX >> 6; wordX <= toX >> 6; ++wordX)
+            {
+                if (row[wordX] & spanMask(wordX, fromX, toX)) return true;
+            }
+            return false;
+        }
+
+        // queries on every cell a rectangle in world coordinates touches
+
+        bool anySolid(Rectangle rect) const
+        {
+            int minX, minY, maxX, maxY;
+            if (!cellRange(rect, minX, minY, maxX, maxY)) return false;
+
+            for (int y = minY; y <= maxY; ++y)
+            {
+                if (anySolidInRow(y, minX, maxX)) return true;
+            }
+            return false;
+        }
+
+        int countSolid(Rectangle rect) const
+        {
+            int minX, minY, maxX, maxY;
+            if (!cellRange(rect, minX, minY, maxX, maxY)) return 0;
+
+            int count = 0;
+            for (int y = minY; y <= maxY; ++y)
+            {
+                const uint64_t* row = &m_words[(size_t)y * m_wordsPerRow];
+                for (int wordX = minX >> 6; wordX <= maxX >> 6; ++wordX)
+                {
+                    count += std::popcount(row[wordX] & spanMask(wordX, minX, maxX));
+                }
+            }
+            return count;
+        }
+
+        // appends the indices of the solid cells, row by row
+
+        void solidCells(Rectangle rect, std::vector<int>& out) const
+        {
+            int minX, minY, maxX, maxY;
+            if (!cellRange(rect, minX, minY, maxX, maxY)) return;
+
+            for (int y = minY; y <= maxY; ++y)
+            {
+                const uint64_t* row = &m_words[(size_t)y * m_wordsPerRow];
+                for (int wordX = minX >> 6; wordX <= maxX >> 6; ++wordX)
+                {
+                    uint64_t bits = row[wordX] & spanMask(wordX, minX, maxX);
+                    while (bits)
+                    {
+                        out.push_back(y * m_mapWidth + wordX * 64 + std::countr_zero(bits));
+                        bits &= bits - 1;
+                    }
+                }
+            }
+        }
+
+        ChangeTracker& changes() {return m_changes;}
+
+        // build a distance field to the nearest solid cell, distances beyond maxDistance cells are capped
+        // updateDistanceField has to be called after edits, it only rebuilds around the changed cells
+
+        void enableDistanceField(int maxDistance = 16)
+        {
+            m_distanceField = std::make_unique<DistanceField>(m_mapWidth, m_mapHeight, maxDistance);
+            m_distanceSubscriber = m_changes.subscribe();
+            updateDistanceField();
+        }
+
+        void updateDistanceField()
+        {
+            if (!m_distanceField) return;
+
+            m_changes.take(m_distanceSubscriber, m_distanceChanges);
+            if (m_distanceChanges.empty()) return;
+
+            auto solid = [this](int x, int y) {return getBit(x, y);};
+
+            if (m_distanceChanges.all)
+            {
+                m_distanceField->resize(m_mapWidth, m_mapHeight, m_distanceField->maxDistance());
+                m_distanceField->rebuild(solid);
+                return;
+            }
+
+            // a small box is rebuilt at once, otherwise every cluster of changes on its own
+
+            const DirtyRegion& region = m_distanceChanges.region;
+            const int reach = m_distanceField->maxDistance() * 2;
+
+            if (region.maxX - region.minX <= reach * 2 && region.maxY - region.minY <= reach * 2)
+            {
+                m_distanceField->update(region.minX, region.minY, region.maxX, region.maxY, solid);
+                return;
+            }
+
+            clusterDistanceChanges(reach);
+
+            for (const DirtyRegion& window : m_distanceWindows)
+            {
+                m_distanceField->update(window.minX, window.minY, window.maxX, window.maxY, solid);
+            }
+        }
+
+        bool hasDistanceField() const {return m_distanceField != nullptr;}
+
+        // distance in cells between the cell centers, the cap outside of the map and 0 without a distance field
+
+        float distanceToSolid(int index) const
+        {
+            if (!m_distanceField) return 0.f;
+            if (!indexValid(index)) return (float)m_distanceField->maxDistance();
+            return m_distanceField->distance(index);
+        }
+
+        // distance in px from the cell of worldPos to the nearest solid cell, for square cells
+
+        float distanceToSolid(Vector2 worldPos) const
+        {
+            return distanceToSolid(getIndexWorldPos(worldPos)) * (float)m_rectWidth;
         }
 
         int width() const {return m_mapWidth;}
         int height() const {return m_mapHeight;}
 
-        bool rectPosValid(Vector2 rectPos) 
+        int rectWidth() const {return m_rectWidth;}
+        int rectHeight() const {return m_rectHeight;}
+
+        bool rectPosValid(Vector2 rectPos) const
         {
             return rectPos.x >= 0 && rectPos.x < m_mapWidth &&
                    rectPos.y >= 0 && rectPos.y < m_mapHeight;
         }
 
-        bool indexValid(int index) 
+        bool indexValid(int index) const
         {
             return index >= 0 && index < m_mapWidth * m_mapHeight;
         }
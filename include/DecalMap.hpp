@@ -0,0 +1,224 @@
+#pragma once
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "RenderStats.hpp"
+
+#include <vector>
+#include <memory>
+#include <cmath>
+
+namespace Map
+{
+    // permanent marks on the map (old skid marks), rasterized on the cpu into one image per chunk
+    // the images are only uploaded to the gpu when rendered, so baking also works headless
+
+    struct DecalChunk
+    {
+        std::vector<Color> pixels;
+        Texture2D texture{};
+        bool dirty{false};
+    };
+
+    class DecalMap
+    {
+    private:
+        int m_worldWidth;
+        int m_worldHeight;
+
+        // world size of a chunk in px and decal pixels per world px
+
+        const int m_chunkSize{1024};
+        const float m_scale{0.5f};
+        int m_chunkPixels;
+
+        int m_chunksX;
+        int m_chunksY;
+
+        std::vector<std::unique_ptr<DecalChunk>> m_chunks;
+
+        DecalChunk& getChunk(int chunkX, int chunkY)
+        {
+            std::unique_ptr<DecalChunk>& chunk = m_chunks[chunkY * m_chunksX + chunkX];
+            if (!chunk)
+            {
+                chunk = std::make_unique<DecalChunk>();
+                chunk->pixels.assign(m_chunkPixels * m_chunkPixels, BLANK);
+            }
+            return *chunk;
+        }
+
+        // src over dst with straight alpha, like ColorAlphaBlend, so baked marks build up like the live ones
+        // (raylib is not linked headless, so it is done here)
+
+        static Color blendOver(Color dst, Color src)
+        {
+            if (src.a == 255) return src;
+            if (src.a == 0) return dst;
+
+            const float srcAlpha = src.a / 255.f;
+            const float dstAlpha = dst.a / 255.f * (1.f - srcAlpha);
+            const float alpha = srcAlpha + dstAlpha;
+
+            auto channel = [&](unsigned char s, unsigned char d) {return (unsigned char)((s * srcAlpha + d * dstAlpha) / alpha + 0.5f);};
+            return {channel(src.r, dst.r), channel(src.g, dst.g), channel(src.b, dst.b), (unsigned char)(alpha * 255.f + 0.5f)};
+        }
+
+        // fill a convex quad into one chunk, row by row between the edges crossing the pixel centers
+
+        void fillQuad(DecalChunk& chunk, const Vector2 (&corners)[4], int minX, int minY, int maxX, int maxY, Color color)
+        {
+            for (int y = minY; y <= maxY; ++y)
+            {
+                const float centerY = y + 0.5f;
+                float left = INFINITY;
+                float right = -INFINITY;
+
+                for (int i = 0; i < 4; ++i)
+                {
+                    const Vector2 a = corners[i];
+                    const Vector2 b = corners[(i + 1) % 4];
+
+                    if ((a.y <= centerY) == (b.y <= centerY)) continue;
+
+                    const float x = a.x + (centerY - a.y) / (b.y - a.y) * (b.x - a.x);
+                    left = fminf(left, x);
+                    right = fmaxf(right, x);
+                }
+
+                if (left > right) continue;
+
+                const int fromX = (int)fmaxf(ceilf(left - 0.5f), (float)minX);
+                const int toX = (int)fminf(floorf(right - 0.5f), (float)maxX);
+
+                Color* row = &chunk.pixels[y * m_chunkPixels];
+                for (int x = fromX; x <= toX; ++x) row[x] = blendOver(row[x], color);
+            }
+        }
+
+    public:
+        DecalMap(int worldWidth, int worldHeight)
+            : m_worldWidth(worldWidth)
+            , m_worldHeight(worldHeight)
+        {
+            m_chunkPixels = (int)(m_chunkSize * m_scale);
+            m_chunksX = (m_worldWidth + m_chunkSize - 1) / m_chunkSize;
+            m_chunksY = (m_worldHeight + m_chunkSize - 1) / m_chunkSize;
+            m_chunks.resize(m_chunksX * m_chunksY);
+        }
+
+        // textures have to be unloaded with unloadTextures while the window is open
+
+        ~DecalMap() = default;
+
+        // rasterize a quad in world coordinates into every chunk it touches, parts outside the map are dropped
+
+        void bakeQuad(const Vector2 (&corners)[4], Color color)
+        {
+            float minX = corners[0].x, maxX = corners[0].x;
+            float minY = corners[0].y, maxY = corners[0].y;
+
+            for (int i = 1; i < 4; ++i)
+            {
+                minX = fminf(minX, corners[i].x);
+                maxX = fmaxf(maxX, corners[i].x);
+                minY = fminf(minY, corners[i].y);
+                maxY = fmaxf(maxY, corners[i].y);
+            }
+
+            const int firstChunkX = (int)fmaxf(floorf(minX / m_chunkSize), 0.f);
+            const int firstChunkY = (int)fmaxf(floorf(minY / m_chunkSize), 0.f);
+            const int lastChunkX = (int)fminf(floorf(maxX / m_chunkSize), (float)m_chunksX - 1);
+            const int lastChunkY = (int)fminf(floorf(maxY / m_chunkSize), (float)m_chunksY - 1);
+
+            for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY)
+            {
+                for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX)
+                {
+                    // corners in pixels of this chunk
+
+                    const Vector2 origin = {(float)(chunkX * m_chunkSize), (float)(chunkY * m_chunkSize)};
+                    Vector2 local[4];
+                    for (int i = 0; i < 4; ++i) local[i] = Vector2Scale(Vector2Subtract(corners[i], origin), m_scale);
+
+                    const int fromX = (int)fmaxf(floorf((minX - origin.x) * m_scale), 0.f);
+                    const int fromY = (int)fmaxf(floorf((minY - origin.y) * m_scale), 0.f);
+                    const int toX = (int)fminf(ceilf((maxX - origin.x) * m_scale), (float)m_chunkPixels - 1);
+                    const int toY = (int)fminf(ceilf((maxY - origin.y) * m_scale), (float)m_chunkPixels - 1);
+
+                    DecalChunk& chunk = getChunk(chunkX, chunkY);
+                    fillQuad(chunk, local, fromX, fromY, toX, toY, color);
+                    chunk.dirty = true;
+                }
+            }
+        }
+
+        // draw every visible chunk as one textured quad, dirty chunks are uploaded first
+
+        void render(Camera2D& cam, RenderStats* stats)
+        {
+            Vector2 topLeft = GetScreenToWorld2D({0.f, 0.f}, cam);
+            Vector2 bottomRight = GetScreenToWorld2D({(float)GetScreenWidth(), (float)GetScreenHeight()}, cam);
+
+            const int firstChunkX = (int)fmaxf(floorf(topLeft.x / m_chunkSize), 0.f);
+            const int firstChunkY = (int)fmaxf(floorf(topLeft.y / m_chunkSize), 0.f);
+            const int lastChunkX = (int)fminf(floorf(bottomRight.x / m_chunkSize), (float)m_chunksX - 1);
+            const int lastChunkY = (int)fminf(floorf(bottomRight.y / m_chunkSize), (float)m_chunksY - 1);
+
+            for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY)
+            {
+                for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX)
+                {
+                    DecalChunk* chunk = m_chunks[chunkY * m_chunksX + chunkX].get();
+                    if (!chunk) continue;
+
+                    if (chunk->dirty)
+                    {
+                        if (chunk->texture.id == 0)
+                        {
+                            Image image{chunk->pixels.data(), m_chunkPixels, m_chunkPixels, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+                            chunk->texture = LoadTextureFromImage(image);
+                            SetTextureFilter(chunk->texture, TEXTURE_FILTER_BILINEAR);
+                        }
+                        else UpdateTexture(chunk->texture, chunk->pixels.data());
+                        chunk->dirty = false;
+                    }
+
+                    DrawTexturePro(chunk->texture,
+                        {0.f, 0.f, (float)m_chunkPixels, (float)m_chunkPixels},
+                        {(float)(chunkX * m_chunkSize), (float)(chunkY * m_chunkSize), (float)m_chunkSize, (float)m_chunkSize},
+                        {0.f, 0.f}, 0.f, WHITE);
+
+                    if (stats)
+                    {
+                        stats->drawCalls++;
+                        stats->vertices += 4;
+                    }
+                }
+            }
+        }
+
+        void unloadTextures()
+        {
+            for (auto& chunk : m_chunks)
+            {
+                if (!chunk || chunk->texture.id == 0) continue;
+                UnloadTexture(chunk->texture);
+                chunk->texture = {};
+                chunk->dirty = true;
+            }
+        }
+
+        // chunks with an image and their memory in bytes
+
+        size_t chunkCount() const
+        {
+            size_t count = 0;
+            for (auto& chunk : m_chunks) if (chunk) ++count;
+            return count;
+        }
+
+        size_t memoryUsage() const {return chunkCount() * m_chunkPixels * m_chunkPixels * sizeof(Color);}
+    };
+}
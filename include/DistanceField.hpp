@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace Map
+{
+    // distance from every cell to the nearest solid cell in cells (between cell centers), capped at maxDistance
+    // built with the two pass euclidean distance transform of Felzenszwalb and Huttenlocher, first columns then rows,
+    // each pass is linear in the number of cells
+    // a change only reaches cells closer than maxDistance, so updates rebuild a window around the changed cells
+
+    class DistanceField
+    {
+    private:
+        int m_width{0};
+        int m_height{0};
+        int m_maxDistance{16};
+
+        std::vector<float> m_distance;
+
+        // scratch of the transform, kept to not allocate on every edit
+
+        std::vector<float> m_columns;
+        std::vector<float> m_line;
+        std::vector<float> m_lineOut;
+        std::vector<float> m_parabolaZ;
+        std::vector<int> m_parabolaV;
+
+        static constexpr float far = 1e20f;
+
+        // squared distance transform of one line, lower envelope of the parabolas rooted at every cell
+
+        void transformLine(const float* f, float* out, int n)
+        {
+            int* v = m_parabolaV.data();
+            float* z = m_parabolaZ.data();
+
+            int k = 0;
+            v[0] = 0;
+            z[0] = -far;
+            z[1] = far;
+
+            auto intersection = [&](int q, int p)
+            {
+                return ((f[q] + (float)q * q) - (f[p] + (float)p * p)) / (2.f * (q - p));
+            };
+
+            for (int q = 1; q < n; ++q)
+            {
+                float s = intersection(q, v[k]);
+                while (s <= z[k])
+                {
+                    --k;
+                    s = intersection(q, v[k]);
+                }
+
+                ++k;
+                v[k] = q;
+                z[k] = s;
+                z[k + 1] = far;
+            }
+
+            k = 0;
+            for (int q = 0; q < n; ++q)
+            {
+                while (z[k + 1] < q) ++k;
+                const float d = (float)(q - v[k]);
+                out[q] = d * d + f[v[k]];
+            }
+        }
+
+    public:
+        DistanceField() = default;
+
+        DistanceField(int width, int height, int maxDistance)
+        {
+            resize(width, height, maxDistance);
+        }
+
+        void resize(int width, int height, int maxDistance)
+        {
+            m_width = width;
+            m_height = height;
+            m_maxDistance = std::max(maxDistance, 1);
+            m_distance.assign((size_t)m_width * m_height, (float)m_maxDistance);
+
+            const int line = std::max(m_width, m_height);
+            m_line.resize(line);
+            m_lineOut.resize(line);
+            m_parabolaZ.resize(line + 1);
+            m_parabolaV.resize(line);
+        }
+
+        // rebuild cells minX..maxX, minY..maxY (inclusive), solid(x, y) tells if a cell is solid
+        // solid cells up to maxDistance outside of the window are taken into account
+
+        template<typename Solid>
+        void rebuild(int minX, int minY, int maxX, int maxY, Solid solid)
+        {
+            minX = std::max(minX, 0);
+            minY = std::max(minY, 0);
+            maxX = std::min(maxX, m_width - 1);
+            maxY = std::min(maxY, m_height - 1);
+            if (minX > maxX || minY > maxY) return;
+
+            // the transform runs on the window grown by the cap
+
+            const int fromX = std::max(minX - m_maxDistance, 0);
+            const int fromY = std::max(minY - m_maxDistance, 0);
+            const int toX = std::min(maxX + m_maxDistance, m_width - 1);
+            const int toY = std::min(maxY + m_maxDistance, m_height - 1);
+
+            const int windowWidth = toX - fromX + 1;
+            const int windowHeight = toY - fromY + 1;
+
+            m_columns.resize((size_t)windowWidth * windowHeight);
+
+            // pass 1: columns, stored column major
+
+            for (int x = 0; x < windowWidth; ++x)
+            {
+                for (int y = 0; y < windowHeight; ++y) m_line[y] = solid(fromX + x, fromY + y) ? 0.f : far;
+                transformLine(m_line.data(), &m_columns[(size_t)x * windowHeight], windowHeight);
+            }
+
+            // pass 2: rows, only the cells of the window are written back
+
+            const float maxSquared = (float)m_maxDistance * m_maxDistance;
+
+            for (int y = minY - fromY; y <= maxY - fromY; ++y)
+            {
+                for (int x = 0; x < windowWidth; ++x) m_line[x] = m_columns[(size_t)x * windowHeight + y];
+                transformLine(m_line.data(), m_lineOut.data(), windowWidth);
+
+                float* row = &m_distance[(size_t)(fromY + y) * m_width];
+                for (int x = minX - fromX; x <= maxX - fromX; ++x)
+                {
+                    row[fromX + x] = sqrtf(std::min(m_lineOut[x], maxSquared));
+                }
+            }
+        }
+
+        template<typename Solid>
+        void rebuild(Solid solid)
+        {
+            rebuild(0, 0, m_width - 1, m_height - 1, solid);
+        }
+
+        // the area a change of cells minX..maxX, minY..maxY can reach
+
+        template<typename Solid>
+        void update(int minX, int minY, int maxX, int maxY, Solid solid)
+        {
+            rebuild(minX - m_maxDistance, minY - m_maxDistance, maxX + m_maxDistance, maxY + m_maxDistance, solid);
+        }
+
+        float distance(int x, int y) const {return m_distance[(size_t)y * m_width + x];}
+        float distance(int index) const {return m_distance[index];}
+
+        int maxDistance() const {return m_maxDistance;}
+    };
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace Map
+{
+    // append only log of map edits next to the map file (<map>.journal), little endian:
+    // header, then one fixed size record per edit, a record cut off by a crash is ignored on replay
+
+    constexpr char journalMagic[4] = {'R', 'G', 'J', 'L'};
+    constexpr uint32_t journalVersion = 1;
+    constexpr const char* journalExtension = ".journal";
+
+    enum class JournalLayer : uint8_t
+    {
+        TILE = 0,
+        COLLISION = 1
+    };
+
+    struct JournalRecord
+    {
+        uint32_t index;
+        JournalLayer layer;
+        uint8_t value;
+        uint8_t reserved[2];
+    };
+
+    static_assert(sizeof(JournalRecord) == 8, "JournalRecord must not have padding");
+
+    class EditJournal
+    {
+    private:
+        std::string m_path;
+        std::FILE* m_file{nullptr};
+
+        std::vector<JournalRecord> m_buffer;
+        size_t m_records{0};
+
+        void writeHeader()
+        {
+            uint32_t version = journalVersion;
+            if (std::fwrite(journalMagic, sizeof(journalMagic), 1, m_file) != 1 ||
+                std::fwrite(&version, sizeof(version), 1, m_file) != 1)
+            {
+                throw std::runtime_error("EditJournal: writing " + m_path + " failed!");
+            }
+        }
+
+    public:
+        // reads the records of an existing journal, an empty list when there is none
+
+        static std::vector<JournalRecord> read(const std::string& path)
+        {
+            std::vector<JournalRecord> records;
+
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file || file.tellg() == 0) return records;
+            file.seekg(0);
+
+            char magic[sizeof(journalMagic)]{};
+            uint32_t version{};
+            file.read(magic, sizeof(magic));
+            file.read(reinterpret_cast<char*>(&version), sizeof(version));
+
+            if (!file || std::memcmp(magic, journalMagic, sizeof(magic)) != 0) throw std::runtime_error("EditJournal: file " + path + " is no journal!");
+            if (version != journalVersion) throw std::runtime_error("EditJournal: unsupported journal version " + std::to_string(version) + "!");
+
+            JournalRecord record;
+            while (file.read(reinterpret_cast<char*>(&record), sizeof(record))) records.push_back(record);
+
+            return records;
+        }
+
+        // opens the journal for appending, a missing journal gets a header
+        // a record cut off by a crash is dropped here, so new records stay aligned
+
+        explicit EditJournal(std::string path)
+            : m_path(std::move(path))
+        {
+            std::vector<JournalRecord> records = read(m_path);
+            m_records = records.size();
+
+            std::error_code error;
+            const uintmax_t size = std::filesystem::file_size(m_path, error);
+            const uintmax_t expected = sizeof(journalMagic) + sizeof(uint32_t) + records.size() * sizeof(JournalRecord);
+
+            if (error || size == 0)
+            {
+                m_file = std::fopen(m_path.c_str(), "wb");
+                if (!m_file) throw std::runtime_error("EditJournal: file " + m_path + " couldnt open!");
+
+                writeHeader();
+                std::fflush(m_file);
+                return;
+            }
+
+            // only the partial tail is cut, the complete records are never rewritten, so a crash here loses nothing
+
+            if (size > expected) std::filesystem::resize_file(m_path, expected);
+
+            m_file = std::fopen(m_path.c_str(), "ab");
+            if (!m_file) throw std::runtime_error("EditJournal: file " + m_path + " couldnt open!");
+        }
+
+        ~EditJournal()
+        {
+            if (!m_file) return;
+            std::fwrite(m_buffer.data(), sizeof(JournalRecord), m_buffer.size(), m_file);
+            std::fclose(m_file);
+        }
+
+        EditJournal(const EditJournal&) = delete;
+        EditJournal& operator=(const EditJournal&) = delete;
+
+        void append(JournalLayer layer, int index, uint8_t value)
+        {
+            m_buffer.push_back({(uint32_t)index, layer, value, {0, 0}});
+        }
+
+        // write buffered records and hand them to the os, after this they survive a crash of the game
+
+        void flush()
+        {
+            if (m_buffer.empty()) return;
+
+            if (std::fwrite(m_buffer.data(), sizeof(JournalRecord), m_buffer.size(), m_file) != m_buffer.size() ||
+                std::fflush(m_file) != 0)
+            {
+                throw std::runtime_error("EditJournal: writing " + m_path + " failed!");
+            }
+
+            m_records += m_buffer.size();
+            m_buffer.clear();
+        }
+
+        // empty the journal after its edits were written into the map
+
+        void clear()
+        {
+            m_buffer.clear();
+            m_records = 0;
+
+            std::fclose(m_file);
+            m_file = std::fopen(m_path.c_str(), "wb");
+            if (!m_file) throw std::runtime_error("EditJournal: file " + m_path + " couldnt open!");
+            writeHeader();
+            std::fflush(m_file);
+        }
+
+        size_t records() const {return m_records + m_buffer.size();}
+        const std::string& path() const {return m_path;}
+    };
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "CarInput.hpp"
+#include "MapCodec.hpp"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+
+// inputs of one car for every tick of a session, to replay it tick by tick with the same results
+// an input packs into 6 bits, equal inputs of following ticks are one run
+// file, little endian: magic, version, tick rate, ai car count, tick count, then one LEB128 varint per run
+// with (ticks - 1) << 6 | input bits, so a run of one or two ticks is one byte
+
+constexpr char inputLogMagic[4] = {'R', 'G', 'I', 'N'};
+constexpr uint32_t inputLogVersion = 1;
+
+inline uint8_t packInput(const CarInput& input)
+{
+    return (uint8_t)(input.forward << 0 | input.backward << 1 | input.left << 2 |
+                     input.right << 3 | input.handBrake << 4 | input.boost << 5);
+}
+
+inline CarInput unpackInput(uint8_t bits)
+{
+    CarInput input;
+    input.forward = bits & (1 << 0);
+    input.backward = bits & (1 << 1);
+    input.left = bits & (1 << 2);
+    input.right = bits & (1 << 3);
+    input.handBrake = bits & (1 << 4);
+    input.boost = bits & (1 << 5);
+    return input;
+}
+
+struct InputRun
+{
+    uint8_t bits;
+    uint32_t ticks;
+};
+
+class InputLog
+{
+private:
+    static constexpr uint32_t maxRunTicks = 1u << 26;
+
+    float m_tickRate{120.f};
+    uint32_t m_aiCars{0};
+    uint64_t m_ticks{0};
+
+    std::vector<InputRun> m_runs;
+
+public:
+    // a replay builds this many cars, more than a race ever has means a broken file
+
+    static constexpr uint32_t maxAiCars = 1024;
+
+    InputLog() = default;
+
+    // the game settings a replay needs to give the same trajectories
+
+    InputLog(float tickRate, uint32_t aiCars)
+        : m_tickRate(tickRate)
+        , m_aiCars(aiCars)
+    {}
+
+    void append(const CarInput& input)
+    {
+        const uint8_t bits = packInput(input);
+
+        if (!m_runs.empty() && m_runs.back().bits == bits && m_runs.back().ticks < maxRunTicks) ++m_runs.back().ticks;
+        else m_runs.push_back({bits, 1});
+
+        ++m_ticks;
+    }
+
+    void save(const std::string& path) const
+    {
+        std::vector<uint8_t> data;
+        for (const InputRun& run : m_runs) Map::Codec::writeVarint(data, (run.ticks - 1) << 6 | run.bits);
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) throw std::runtime_error("InputLog::save: file " + path + " couldnt open!");
+
+        file.write(inputLogMagic, sizeof(inputLogMagic));
+        file.write(reinterpret_cast<const char*>(&inputLogVersion), sizeof(inputLogVersion));
+        file.write(reinterpret_cast<const char*>(&m_tickRate), sizeof(m_tickRate));
+        file.write(reinterpret_cast<const char*>(&m_aiCars), sizeof(m_aiCars));
+        file.write(reinterpret_cast<const char*>(&m_ticks), sizeof(m_ticks));
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+        if (!file) throw std::runtime_error("InputLog::save: writing " + path + " failed!");
+    }
+
+    static InputLog load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) throw std::runtime_error("InputLog::load: file " + path + " couldnt open!");
+
+        char magic[sizeof(inputLogMagic)]{};
+        uint32_t version{};
+        InputLog log;
+
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char*>(&version), sizeof(version));
+        file.read(reinterpret_cast<char*>(&log.m_tickRate), sizeof(log.m_tickRate));
+        file.read(reinterpret_cast<char*>(&log.m_aiCars), sizeof(log.m_aiCars));
+
+        uint64_t ticks{};
+        file.read(reinterpret_cast<char*>(&ticks), sizeof(ticks));
+
+        if (!file || std::memcmp(magic, inputLogMagic, sizeof(magic)) != 0) throw std::runtime_error("InputLog::load: file " + path + " is no input log!");
+        if (version != inputLogVersion) throw std::runtime_error("InputLog::load: unsupported version " + std::to_string(version) + "!");
+        if (!std::isfinite(log.m_tickRate) || log.m_tickRate <= 0.f) throw std::runtime_error("InputLog::load: " + path + " has an invalid tick rate!");
+        if (log.m_aiCars > maxAiCars) throw std::runtime_error("InputLog::load: " + path + " has " + std::to_string(log.m_aiCars) + " ai cars, at most " + std::to_string(maxAiCars) + "!");
+
+        const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        const uint8_t* read = data.data();
+        const uint8_t* end = read + data.size();
+
+        while (read < end)
+        {
+            const uint32_t value = Map::Codec::readVarint(read, end);
+            log.m_runs.push_back({(uint8_t)(value & 0x3f), (value >> 6) + 1});
+            log.m_ticks += log.m_runs.back().ticks;
+        }
+
+        if (log.m_ticks != ticks) throw std::runtime_error("InputLog::load: " + path + " has " + std::to_string(log.m_ticks) + " of " + std::to_string(ticks) + " ticks!");
+
+        return log;
+    }
+
+    const std::vector<InputRun>& runs() const {return m_runs;}
+
+    float tickRate() const {return m_tickRate;}
+    uint32_t aiCars() const {return m_aiCars;}
+    uint64_t ticks() const {return m_ticks;}
+};
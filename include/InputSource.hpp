@@ -0,0 +1,87 @@
+#pragma once
+
+#include <raylib.h>
+
+#include "CarInput.hpp"
+#include "InputLog.hpp"
+
+#include <functional>
+
+// where the inputs of a car come from, one next() per tick
+// live sources (keyboard, scripts) read through a function and can be recorded into an InputLog,
+// a replay gives the inputs of a log back tick by tick and then none
+
+class InputSource
+{
+private:
+    std::function<CarInput()> m_read;
+
+    InputLog* m_recording{nullptr};
+
+    const InputLog* m_replay{nullptr};
+    size_t m_replayRun{0};
+    uint32_t m_replayTick{0};
+
+public:
+    explicit InputSource(std::function<CarInput()> read)
+        : m_read(std::move(read))
+    {}
+
+    static InputSource keyboard()
+    {
+        return InputSource([]
+        {
+            CarInput input;
+
+            input.right = IsKeyDown(KEY_D);
+            input.left = IsKeyDown(KEY_A);
+            input.forward = IsKeyDown(KEY_W);
+            input.backward = IsKeyDown(KEY_S);
+            input.handBrake = IsKeyDown(KEY_SPACE);
+            input.boost = IsKeyDown(KEY_LEFT_SHIFT);
+
+            return input;
+        });
+    }
+
+    // log has to outlive the source
+
+    static InputSource replay(const InputLog& log)
+    {
+        InputSource source(nullptr);
+        source.m_replay = &log;
+        return source;
+    }
+
+    // append every input given from now on to log
+
+    void record(InputLog* log) {m_recording = log;}
+
+    CarInput next()
+    {
+        CarInput input;
+
+        if (m_replay)
+        {
+            if (finished()) return input;
+
+            const InputRun& run = m_replay->runs()[m_replayRun];
+            input = unpackInput(run.bits);
+
+            if (++m_replayTick == run.ticks)
+            {
+                ++m_replayRun;
+                m_replayTick = 0;
+            }
+        }
+        else input = m_read();
+
+        if (m_recording) m_recording->append(input);
+
+        return input;
+    }
+
+    // a replay ran out of inputs, live sources never do
+
+    bool finished() const {return m_replay && m_replayRun >= m_replay->runs().size();}
+};
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+
+// work stealing scheduler for the stages of a frame
+// the stages are added once as a graph of jobs with dependencies and run() executes it as often as needed,
+// a job starts when all jobs it depends on finished, independent jobs run at the same time on different threads
+// every thread has its own deque, it takes its newest job from the back and steals the oldest of others from the front
+// the thread calling run() works too (thread 0), jobs can split loops with parallelFor
+// start and end of every job are kept per run, criticalPath() gives the chain of jobs that bounds the frame time
+
+class JobSystem
+{
+public:
+    using JobId = size_t;
+
+    // times in ms since the start of the last run
+
+    struct JobTiming
+    {
+        std::string name;
+        double start{0.0};
+        double end{0.0};
+        int thread{0};
+    };
+
+private:
+    struct Job
+    {
+        std::function<void()> task;
+        std::vector<JobId> dependencies;
+        std::vector<Job*> successors;
+        std::atomic<size_t> waitingFor{0};
+
+        // graph jobs are timed, parallelFor batches count down the counter of their loop instead
+
+        JobTiming* timing{nullptr};
+        std::atomic<size_t>* counter{nullptr};
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job*> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::deque<Job> m_jobs;
+    std::vector<JobTiming> m_timings;
+
+    // sleeping threads wait for m_queued, the caller of run() also for m_unfinished
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    std::atomic<size_t> m_queued{0};
+    std::atomic<size_t> m_unfinished{0};
+    bool m_stop{false};
+
+    std::mutex m_errorMutex;
+    std::exception_ptr m_error;
+
+    std::chrono::steady_clock::time_point m_runStart;
+
+    // index of the queue of the current thread, workers set it once, every other thread is 0
+
+    static int& threadIndex()
+    {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    double now() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_runStart).count();
+    }
+
+    void push(Job* job)
+    {
+        Queue& queue = *m_queues[threadIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        ++m_queued;
+
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+
+    Job* take()
+    {
+        const size_t own = threadIndex();
+
+        for (size_t i = 0; i < m_queues.size(); ++i)
+        {
+            Queue& queue = *m_queues[(own + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty()) continue;
+
+            Job* job = nullptr;
+            if (i == 0)
+            {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+
+            --m_queued;
+            return job;
+        }
+
+        return nullptr;
+    }
+
+    void execute(Job* job)
+    {
+        if (job->timing)
+        {
+            job->timing->thread = threadIndex();
+            job->timing->start = now();
+        }
+
+        try
+        {
+            job->task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            if (!m_error) m_error = std::current_exception();
+        }
+
+        if (job->timing) job->timing->end = now();
+
+        for (Job* successor : job->successors)
+        {
+            if (--successor->waitingFor == 0) push(successor);
+        }
+
+        if (job->counter) --*job->counter;
+        else if (--m_unfinished == 0)
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_wake.notify_all();
+        }
+    }
+
+    void workerLoop(int index)
+    {
+        threadIndex() = index;
+
+        while (true)
+        {
+            if (Job* job = take())
+            {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wake.wait(lock, [this] {return m_stop || m_queued > 0;});
+            if (m_stop) return;
+        }
+    }
+
+    void rethrow()
+    {
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            std::swap(error, m_error);
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+public:
+    // threads counts the calling thread, 0 uses every core
+
+    explicit JobSystem(size_t threads = 0)
+    {
+        if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+        for (size_t i = 0; i < threads; ++i) m_queues.push_back(std::make_unique<Queue>());
+        for (size_t i = 1; i < threads; ++i) m_threads.emplace_back(&JobSystem::workerLoop, this, (int)i);
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& thread : m_threads) thread.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // add a job to the graph, it runs after every job in dependencies, those have to be added before
+
+    JobId add(std::string name, std::function<void()> task, std::vector<JobId> dependencies = {})
+    {
+        const JobId id = m_jobs.size();
+
+        for (JobId dependency : dependencies)
+        {
+            if (dependency >= id) throw std::runtime_error("JobSystem::add: " + name + " depends on a job added later !");
+        }
+
+        Job& job = m_jobs.emplace_back();
+        job.task = std::move(task);
+        job.dependencies = std::move(dependencies);
+
+        for (JobId dependency : job.dependencies) m_jobs[dependency].successors.push_back(&job);
+
+        m_timings.push_back({std::move(name)});
+        for (size_t i = 0; i < m_jobs.size(); ++i) m_jobs[i].timing = &m_timings[i];
+
+        return id;
+    }
+
+    void clear()
+    {
+        m_jobs.clear();
+        m_timings.clear();
+    }
+
+    // execute the graph once and return when every job finished, an exception of a job is rethrown here
+    // only one thread may call run()
+
+    void run()
+    {
+        if (m_jobs.empty()) return;
+
+        m_runStart = std::chrono::steady_clock::now();
+        m_unfinished = m_jobs.size();
+
+        for (Job& job : m_jobs) job.waitingFor = job.dependencies.size();
+        for (Job& job : m_jobs)
+        {
+            if (job.dependencies.empty()) push(&job);
+        }
+
+        while (m_unfinished > 0)
+        {
+            if (Job* job = take())
+            {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wake.wait(lock, [this] {return m_unfinished == 0 || m_queued > 0;});
+        }
+
+        rethrow();
+    }
+
+    // calls task(i) for every i below count in batches spread over the threads, from a job or outside of run()
+    // the calling thread runs batches (and other jobs) until the loop is done
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& task)
+    {
+        if (count == 0) return;
+
+        if (m_threads.empty() || count == 1)
+        {
+            for (size_t i = 0; i < count; ++i) task(i);
+            return;
+        }
+
+        const size_t batchCount = std::min(count, threadCount() * 4);
+        const size_t grain = (count + batchCount - 1) / batchCount;
+
+        std::vector<Job> batches(batchCount);
+        std::atomic<size_t> remaining{batchCount};
+
+        for (size_t b = 0; b < batchCount; ++b)
+        {
+            batches[b].task = [&task, b, grain, count]
+            {
+                const size_t end = std::min((b + 1) * grain, count);
+                for (size_t i = b * grain; i < end; ++i) task(i);
+            };
+            batches[b].counter = &remaining;
+            push(&batches[b]);
+        }
+
+        while (remaining > 0)
+        {
+            if (Job* job = take()) execute(job);
+            else std::this_thread::yield();
+        }
+
+        // inside a job the error is kept for run(), outside it is thrown here
+
+        if (m_unfinished == 0) rethrow();
+    }
+
+    // jobs of the longest chain of dependencies, by the times of the last run, first to last
+
+    std::vector<JobId> criticalPath() const
+    {
+        std::vector<double> finish(m_jobs.size(), 0.0);
+        std::vector<JobId> previous(m_jobs.size(), m_jobs.size());
+
+        JobId last = 0;
+
+        for (JobId id = 0; id < m_jobs.size(); ++id)
+        {
+            double ready = 0.0;
+            for (JobId dependency : m_jobs[id].dependencies)
+            {
+                if (finish[dependency] <= ready) continue;
+                ready = finish[dependency];
+                previous[id] = dependency;
+            }
+
+            finish[id] = ready + (m_timings[id].end - m_timings[id].start);
+            if (finish[id] > finish[last]) last = id;
+        }
+
+        std::vector<JobId> path;
+        if (m_jobs.empty()) return path;
+
+        for (JobId id = last; id < m_jobs.size(); id = previous[id]) path.push_back(id);
+        std::reverse(path.begin(), path.end());
+
+        return path;
+    }
+
+    const std::vector<JobTiming>& timings() const {return m_timings;}
+    size_t threadCount() const {return m_queues.size();}
+};
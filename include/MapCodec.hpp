@@ -0,0 +1,204 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+namespace Map
+{
+    // compression of one map layer with one byte value per cell, used by binary maps since version 2
+    // the layer is cut into blocks of codecBlockSize cells, every block is stored in the smallest of:
+    // CONSTANT  one value for the whole block
+    // PACKED    1, 2, 4 or 8 bits per cell, lowest bits first
+    // RUNS      pairs of value and run length (LEB128)
+
+    constexpr size_t codecBlockSize = 4096;
+
+    enum class BlockMode : uint8_t
+    {
+        CONSTANT = 0,
+        PACKED = 1,
+        RUNS = 2
+    };
+
+    namespace Codec
+    {
+        inline void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+        {
+            while (value >= 0x80)
+            {
+                out.push_back((uint8_t)(value | 0x80));
+                value >>= 7;
+            }
+            out.push_back((uint8_t)value);
+        }
+
+        inline uint32_t readVarint(const uint8_t*& data, const uint8_t* end)
+        {
+            uint32_t value = 0;
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                if (data >= end) break;
+                const uint8_t byte = *data++;
+                value |= (uint32_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return value;
+            }
+            throw std::runtime_error("decodeLayer: broken run length!");
+        }
+
+        inline int packedBits(uint8_t maxValue)
+        {
+            if (maxValue < 2) return 1;
+            if (maxValue < 4) return 2;
+            if (maxValue < 16) return 4;
+            return 8;
+        }
+
+        inline size_t varintSize(uint32_t value)
+        {
+            size_t size = 1;
+            while (value >= 0x80)
+            {
+                value >>= 7;
+                ++size;
+            }
+            return size;
+        }
+    }
+
+    inline std::vector<uint8_t> encodeLayer(const uint8_t* values, size_t count)
+    {
+        std::vector<uint8_t> out;
+
+        for (size_t blockStart = 0; blockStart < count; blockStart += codecBlockSize)
+        {
+            const uint8_t* block = values + blockStart;
+            const size_t cells = std::min(codecBlockSize, count - blockStart);
+
+            // measure both encodings before writing one
+
+            uint8_t maxValue = 0;
+            size_t runs = 0;
+            size_t runBytes = 0;
+
+            for (size_t i = 0; i < cells;)
+            {
+                size_t j = i + 1;
+                while (j < cells && block[j] == block[i]) ++j;
+
+                maxValue = std::max(maxValue, block[i]);
+                ++runs;
+                runBytes += 1 + Codec::varintSize((uint32_t)(j - i));
+                i = j;
+            }
+
+            if (runs == 1)
+            {
+                out.push_back((uint8_t)BlockMode::CONSTANT);
+                out.push_back(block[0]);
+                continue;
+            }
+
+            const int bits = Codec::packedBits(maxValue);
+            const size_t packedBytes = 1 + (cells * bits + 7) / 8;
+
+            if (runBytes < packedBytes)
+            {
+                out.push_back((uint8_t)BlockMode::RUNS);
+
+                for (size_t i = 0; i < cells;)
+                {
+                    size_t j = i + 1;
+                    while (j < cells && block[j] == block[i]) ++j;
+
+                    out.push_back(block[i]);
+                    Codec::writeVarint(out, (uint32_t)(j - i));
+                    i = j;
+                }
+                continue;
+            }
+
+            out.push_back((uint8_t)BlockMode::PACKED);
+            out.push_back((uint8_t)bits);
+
+            const size_t first = out.size();
+            out.resize(first + packedBytes - 1, 0);
+
+            for (size_t i = 0; i < cells; ++i)
+            {
+                const size_t bit = i * bits;
+                out[first + (bit >> 3)] |= (uint8_t)(block[i] << (bit & 7));
+            }
+        }
+
+        return out;
+    }
+
+    // decode count cells into out, throws when the data is broken or too short
+
+    inline void decodeLayer(const uint8_t* data, size_t size, uint8_t* out, size_t count)
+    {
+        const uint8_t* end = data + size;
+
+        for (size_t blockStart = 0; blockStart < count; blockStart += codecBlockSize)
+        {
+            uint8_t* block = out + blockStart;
+            const size_t cells = std::min(codecBlockSize, count - blockStart);
+
+            if (data >= end) throw std::runtime_error("decodeLayer: layer is truncated!");
+            const BlockMode mode = static_cast<BlockMode>(*data++);
+
+            switch (mode)
+            {
+            case BlockMode::CONSTANT:
+            {
+                if (data >= end) throw std::runtime_error("decodeLayer: layer is truncated!");
+                std::memset(block, *data++, cells);
+                break;
+            }
+            case BlockMode::PACKED:
+            {
+                if (data >= end) throw std::runtime_error("decodeLayer: layer is truncated!");
+                const int bits = *data++;
+                if (bits != 1 && bits != 2 && bits != 4 && bits != 8) throw std::runtime_error("decodeLayer: invalid bits per cell!");
+
+                const size_t bytes = (cells * bits + 7) / 8;
+                if ((size_t)(end - data) < bytes) throw std::runtime_error("decodeLayer: layer is truncated!");
+
+                if (bits == 8) std::memcpy(block, data, cells);
+                else
+                {
+                    const uint8_t mask = (uint8_t)((1 << bits) - 1);
+                    for (size_t i = 0; i < cells; ++i)
+                    {
+                        const size_t bit = i * bits;
+                        block[i] = (data[bit >> 3] >> (bit & 7)) & mask;
+                    }
+                }
+                data += bytes;
+                break;
+            }
+            case BlockMode::RUNS:
+            {
+                size_t i = 0;
+                while (i < cells)
+                {
+                    if (data >= end) throw std::runtime_error("decodeLayer: layer is truncated!");
+                    const uint8_t value = *data++;
+                    const uint32_t length = Codec::readVarint(data, end);
+                    if (length == 0 || length > cells - i) throw std::runtime_error("decodeLayer: run is longer than its block!");
+
+                    std::memset(block + i, value, length);
+                    i += length;
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("decodeLayer: unknown block mode " + std::to_string((int)mode) + "!");
+            }
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+
+namespace Map
+{
+    // binary map file (.rgm), little endian: header, tile layer, collision layer
+    // version 1: one byte per tile and one bit per collision cell (row major, lowest bit first),
+    //            read straight from the mapped file without parsing
+    // version 2: both layers compressed with encodeLayer (MapCodec.hpp), the sizes are the compressed sizes
+
+    constexpr char binaryMapMagic[4] = {'R', 'G', 'M', 'P'};
+    constexpr uint32_t binaryMapVersionRaw = 1;
+    constexpr uint32_t binaryMapVersionCompressed = 2;
+    constexpr uint32_t binaryMapVersion = binaryMapVersionCompressed;
+    constexpr const char* binaryMapExtension = ".rgm";
+
+    struct BinaryMapHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t mapWidth;
+        uint32_t mapHeight;
+        uint64_t tileOffset;
+        uint64_t tileSize;
+        uint64_t collisionOffset;
+        uint64_t collisionSize;
+    };
+
+    static_assert(sizeof(BinaryMapHeader) == 48, "BinaryMapHeader must not have padding");
+
+    inline bool hasBinaryMapMagic(const void* data, size_t size)
+    {
+        return size >= sizeof(binaryMapMagic) && std::memcmp(data, binaryMapMagic, sizeof(binaryMapMagic)) == 0;
+    }
+
+    // checks the first bytes, not the extension
+
+    inline bool isBinaryMap(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[sizeof(binaryMapMagic)]{};
+        if (!file.read(magic, sizeof(magic))) return false;
+        return hasBinaryMapMagic(magic, sizeof(magic));
+    }
+
+    inline bool hasBinaryMapExtension(const std::string& path)
+    {
+        const std::string extension = binaryMapExtension;
+        return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+    }
+}
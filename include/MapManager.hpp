@@ -2,23 +2,135 @@
 
 #include "TileMap.hpp"
 #include "CollisionMap.hpp"
+#include "DecalMap.hpp"
+#include "MapFormat.hpp"
+#include "MapCodec.hpp"
+#include "MappedFile.hpp"
+#include "EditJournal.hpp"
+
+#include <thread>
+#include <filesystem>
+#include <atomic>
 
 namespace Map
 {
+    enum class LoadState
+    {
+        IDLE,
+        LOADING,
+        FINISHED,
+        FAILED
+    };
+
     class MapManager
     {
     private:
         std::unique_ptr<TileMap> m_currentTileMap;
         std::unique_ptr<CollisionMap> m_currentCollisionMap;
+        std::unique_ptr<DecalMap> m_currentDecalMap;
 
-    public:
-        void createMap(int tileWidth, int tileHeight, int mapWidth, int mapHeight)
+        // subscriptions to the tile and collision changes, to know if the map needs saving
+
+        int m_tileSaveSubscriber{-1};
+        int m_collisionSaveSubscriber{-1};
+        ChangeSet m_saveChanges;
+
+        void subscribeSave()
         {
-            m_currentTileMap = std::make_unique<TileMap>(tileWidth, tileHeight, mapWidth, mapHeight);
-            m_currentCollisionMap = std::make_unique<CollisionMap>(tileWidth, tileHeight, mapWidth, mapHeight);
+            m_tileSaveSubscriber = m_currentTileMap->changes().subscribe();
+            m_collisionSaveSubscriber = m_currentCollisionMap->changes().subscribe();
+
+            // the map as created or loaded is what is on disk
+
+            m_currentTileMap->changes().take(m_tileSaveSubscriber, m_saveChanges);
+            m_currentCollisionMap->changes().take(m_collisionSaveSubscriber, m_saveChanges);
         }
 
-        void loadMap(std::string path, int tileWidth, int tileHeight)
+        // everything a load creates, built on the loading thread and installed on the main thread
+
+        struct LoadedMap
+        {
+            std::unique_ptr<TileMap> tileMap;
+            std::unique_ptr<CollisionMap> collisionMap;
+            std::unique_ptr<DecalMap> decalMap;
+        };
+
+        static LoadedMap readMapBinary(const std::string& path, int tileWidth, int tileHeight, std::atomic<float>& progress)
+        {
+            MappedFile file(path);
+
+            BinaryMapHeader header;
+            if (file.size() < sizeof(header)) throw std::runtime_error("loadMap: file " + path + " is too small for a map header!");
+            std::memcpy(&header, file.data(), sizeof(header));
+
+            if (!hasBinaryMapMagic(header.magic, sizeof(header.magic))) throw std::runtime_error("loadMap: file " + path + " is no binary map!");
+            if (header.version != binaryMapVersionRaw && header.version != binaryMapVersionCompressed)
+            {
+                throw std::runtime_error("loadMap: unsupported binary map version " + std::to_string(header.version) + "!");
+            }
+
+            const uint64_t tileCount = (uint64_t)header.mapWidth * header.mapHeight;
+
+            if (tileCount > INT32_MAX) throw std::runtime_error("loadMap: map size is too big!");
+            if (header.version == binaryMapVersionRaw && (header.tileSize != tileCount || header.collisionSize != (tileCount + 7) / 8))
+            {
+                throw std::runtime_error("loadMap: set map size doesnt equal actual map size!");
+            }
+            // offset + size could wrap around, so the size is checked against what is left after the offset
+
+            const uint64_t fileSize = file.size();
+            if (header.tileOffset > fileSize || header.tileSize > fileSize - header.tileOffset ||
+                header.collisionOffset > fileSize || header.collisionSize > fileSize - header.collisionOffset)
+            {
+                throw std::runtime_error("loadMap: file " + path + " is truncated!");
+            }
+
+            const int mapWidth = (int)header.mapWidth;
+            const int mapHeight = (int)header.mapHeight;
+
+            const uint8_t* tiles = file.data() + header.tileOffset;
+            const uint8_t* collision = file.data() + header.collisionOffset;
+
+            // compressed layers are decoded into memory, collision bytes are packed into bits like version 1
+
+            std::vector<uint8_t> decodedTiles;
+            std::vector<uint8_t> decodedCollision;
+
+            if (header.version == binaryMapVersionCompressed)
+            {
+                decodedTiles.resize(tileCount);
+                decodeLayer(tiles, header.tileSize, decodedTiles.data(), tileCount);
+                tiles = decodedTiles.data();
+
+                decodedCollision.resize(tileCount);
+                decodeLayer(collision, header.collisionSize, decodedCollision.data(), tileCount);
+
+                std::vector<uint8_t> bits ((tileCount + 7) / 8, 0);
+                for (uint64_t i = 0; i < tileCount; ++i) if (decodedCollision[i]) bits[i >> 3] |= (uint8_t)(1 << (i & 7));
+                decodedCollision = std::move(bits);
+                collision = decodedCollision.data();
+            }
+
+            progress = 0.25f;
+
+            // created empty, the layers fill them in one pass
+
+            LoadedMap map;
+
+            map.tileMap = std::make_unique<TileMap>(tileWidth, tileHeight, 0, 0);
+            map.tileMap->loadLayer(tiles, mapWidth, mapHeight);
+            progress = 0.5f;
+
+            map.collisionMap = std::make_unique<CollisionMap>(tileWidth, tileHeight, 0, 0);
+            map.collisionMap->loadBits(collision, mapWidth, mapHeight);
+
+            map.decalMap = std::make_unique<DecalMap>(tileWidth * mapWidth, tileHeight * mapHeight);
+            progress = 1.f;
+
+            return map;
+        }
+
+        static LoadedMap readMapText(const std::string& path, int tileWidth, int tileHeight, std::atomic<float>& progress)
         {
             std::vector<int> tileMap;
             std::vector<int> collisionMap;
@@ -39,6 +151,10 @@ namespace Map
             
             tileMap.reserve(mapWidth * mapHeight);
 
+            // parsing is nearly all of the load time, both layers count half
+
+            const float valueProgress = mapWidth * mapHeight > 0 ? 0.5f / ((float)mapWidth * mapHeight) : 0.f;
+
             while (std::getline(file, line))
             {
                 if (line.empty()) continue; 
@@ -53,10 +169,18 @@ namespace Map
                 
                 std::istringstream (first) >> x;
                 tileMap.push_back(x);
-                while(sstream >> x) tileMap.push_back(x);    
+                while(sstream >> x) tileMap.push_back(x);
+
+                progress = fminf(tileMap.size() * valueProgress, 0.5f);
             }
 
-            while (file >> x) collisionMap.push_back(x);
+            collisionMap.reserve(mapWidth * mapHeight);
+
+            while (file >> x) 
+            {
+                collisionMap.push_back(x);
+                if (mapWidth > 0 && collisionMap.size() % mapWidth == 0) progress = fminf(0.5f + collisionMap.size() * valueProgress, 1.f);
+            }
 
             if (tileMap.size() != (size_t)(mapWidth * mapHeight)) 
             {
@@ -68,26 +192,195 @@ namespace Map
                 throw std::runtime_error("loadCollisionMap: set map size doesnt equal actual map size!");
             }
 
-            m_currentTileMap = std::make_unique<TileMap>(tileWidth, tileHeight, mapWidth, mapHeight);
-            m_currentTileMap->loadMap(tileMap, mapWidth, mapHeight);
+            LoadedMap map;
+
+            map.tileMap = std::make_unique<TileMap>(tileWidth, tileHeight, mapWidth, mapHeight);
+            map.tileMap->loadMap(tileMap, mapWidth, mapHeight);
+
+            map.collisionMap = std::make_unique<CollisionMap>(tileWidth, tileHeight, mapWidth, mapHeight);
+            map.collisionMap->loadMap(collisionMap, mapWidth, mapHeight);
+
+            map.decalMap = std::make_unique<DecalMap>(tileWidth * mapWidth, tileHeight * mapHeight);
+            progress = 1.f;
+
+            return map;
+        }
+
+        // text maps and binary maps, the format is detected from the first bytes
+
+        static LoadedMap readMap(const std::string& path, int tileWidth, int tileHeight, std::atomic<float>& progress)
+        {
+            if (isBinaryMap(path)) return readMapBinary(path, tileWidth, tileHeight, progress);
+            return readMapText(path, tileWidth, tileHeight, progress);
+        }
+
+        void install(LoadedMap& map)
+        {
+            // the journal belongs to the replaced map
+
+            if (m_journal) writeJournal();
+            m_journal.reset();
+
+            m_currentTileMap = std::move(map.tileMap);
+            m_currentCollisionMap = std::move(map.collisionMap);
+            m_currentDecalMap = std::move(map.decalMap);
+
+            subscribeSave();
+        }
+
+        // edit journal of the map at m_journalMapPath, see openJournal
 
+        std::unique_ptr<EditJournal> m_journal;
+        std::string m_journalMapPath;
+
+        // state of loadMapAsync, the result is only touched by the main thread after the state says so
+
+        std::thread m_loadThread;
+        std::atomic<LoadState> m_loadState{LoadState::IDLE};
+        std::atomic<float> m_loadProgress{0.f};
+        LoadedMap m_loadResult;
+        std::string m_loadError;
+
+        void saveMapBinary(const std::string& path)
+        {
+            std::vector<int> tileMap = m_currentTileMap->saveMap();
+            std::vector<int> collisionMap = m_currentCollisionMap->saveMap();
+
+            const std::vector<uint8_t> tileValues (tileMap.begin(), tileMap.end());
+            const std::vector<uint8_t> collisionValues (collisionMap.begin(), collisionMap.end());
+
+            std::vector<uint8_t> tiles = encodeLayer(tileValues.data(), tileValues.size());
+            std::vector<uint8_t> collision = encodeLayer(collisionValues.data(), collisionValues.size());
+
+            BinaryMapHeader header{};
+            std::memcpy(header.magic, binaryMapMagic, sizeof(header.magic));
+            header.version = binaryMapVersion;
+            header.mapWidth = (uint32_t)m_currentTileMap->width();
+            header.mapHeight = (uint32_t)m_currentTileMap->height();
+            header.tileOffset = sizeof(header);
+            header.tileSize = tiles.size();
+            header.collisionOffset = header.tileOffset + header.tileSize;
+            header.collisionSize = collision.size();
+
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            if (!file) throw std::runtime_error("saveMap: File " + path + " couldnt open!");
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(tiles.data()), tiles.size());
+            file.write(reinterpret_cast<const char*>(collision.data()), collision.size());
+
+            if (!file) throw std::runtime_error("saveMap: writing " + path + " failed!");
+        }
+
+    public:
+        void createMap(int tileWidth, int tileHeight, int mapWidth, int mapHeight)
+        {
+            m_currentTileMap = std::make_unique<TileMap>(tileWidth, tileHeight, mapWidth, mapHeight);
             m_currentCollisionMap = std::make_unique<CollisionMap>(tileWidth, tileHeight, mapWidth, mapHeight);
-            m_currentCollisionMap->loadMap(collisionMap, mapWidth, mapHeight);
+            m_currentDecalMap = std::make_unique<DecalMap>(tileWidth * mapWidth, tileHeight * mapHeight);
+
+            subscribeSave();
+        }
+
+        MapManager() = default;
+
+        // waits for a running load, its result is dropped
+
+        ~MapManager()
+        {
+            if (m_loadThread.joinable()) m_loadThread.join();
+        }
+
+        MapManager(const MapManager&) = delete;
+        MapManager& operator=(const MapManager&) = delete;
+
+        // loads text maps and binary maps, the format is detected from the first bytes
+
+        void loadMap(std::string path, int tileWidth, int tileHeight)
+        {
+            std::atomic<float> progress{0.f};
+            LoadedMap map = readMap(path, tileWidth, tileHeight, progress);
+            install(map);
+        }
+
+        // parse and validate a map on a worker thread, the current map stays usable until pollLoad swaps it
+        // the textures of the current map have to be unloaded with unloadTextures before the swap
+
+        void loadMapAsync(std::string path, int tileWidth, int tileHeight)
+        {
+            if (m_loadState == LoadState::LOADING) throw std::runtime_error("loadMapAsync: a map is already loading!");
+            if (m_loadThread.joinable()) m_loadThread.join();
+
+            m_loadProgress = 0.f;
+            m_loadError.clear();
+            m_loadState = LoadState::LOADING;
+
+            m_loadThread = std::thread([this, path, tileWidth, tileHeight]
+            {
+                try
+                {
+                    m_loadResult = readMap(path, tileWidth, tileHeight, m_loadProgress);
+                    m_loadState = LoadState::FINISHED;
+                }
+                catch (const std::exception& e)
+                {
+                    m_loadError = e.what();
+                    m_loadState = LoadState::FAILED;
+                }
+            });
+        }
+
+        // call once per frame on the main thread, installs a finished map and reports FINISHED once
+        // a failed load reports FAILED once with loadError, the current map is kept
+
+        LoadState pollLoad()
+        {
+            const LoadState state = m_loadState;
+            if (state != LoadState::FINISHED && state != LoadState::FAILED) return state;
+
+            m_loadThread.join();
+            if (state == LoadState::FINISHED) install(m_loadResult);
+            m_loadResult = LoadedMap();
+            m_loadState = LoadState::IDLE;
+
+            return state;
+        }
+
+        float loadProgress() const {return m_loadProgress;}
+        const std::string& loadError() const {return m_loadError;}
+
+        // true when a tile or collision changed since the map was loaded or saved
+
+        bool hasUnsavedChanges() const
+        {
+            if (!m_currentTileMap) return false;
+            return m_currentTileMap->changes().hasChanges(m_tileSaveSubscriber) || 
+                   m_currentCollisionMap->changes().hasChanges(m_collisionSaveSubscriber);
         }
 
+        // saves a binary map for paths ending in .rgm, a text map otherwise
+
         void saveMap(std::string path)
         {   
             if (!m_currentTileMap) throw std::runtime_error("saveMap: tried to save without an active map!");
 
+            if (hasBinaryMapExtension(path))
+            {
+                saveMapBinary(path);
+                m_currentTileMap->changes().take(m_tileSaveSubscriber, m_saveChanges);
+                m_currentCollisionMap->changes().take(m_collisionSaveSubscriber, m_saveChanges);
+                return;
+            }
+
             std::vector<int> tileMap = m_currentTileMap->saveMap();
             std::vector<int> collisionMap = m_currentCollisionMap->saveMap();
 
             std::ofstream file(path);
             if (!file) throw std::runtime_error("saveMap: File " + path + " couldnt open!");
 
-            file << m_currentTileMap->width() << " " << m_currentTileMap->height() << std::endl;
+            file << m_currentTileMap->width() << " " << m_currentTileMap->height() << '\n';
 
-            file << "tileMap" << std::endl;
+            file << "tileMap" << '\n';
 
             for (int y = 0; y < m_currentTileMap->height(); ++y)
             {
@@ -100,10 +393,10 @@ namespace Map
                     }
                     file << tileMap[i] << " ";
                 }
-                file << std::endl;
+                file << '\n';
             }
 
-            file << "collisionMap" << std::endl;
+            file << "collisionMap" << '\n';
 
             for (int y = 0; y < m_currentCollisionMap->height(); ++y)
             {
@@ -116,11 +409,130 @@ namespace Map
                     }
                     file << collisionMap[i] << " ";
                 }
-                file << std::endl;
+                file << '\n';
             }
+
+            m_currentTileMap->changes().take(m_tileSaveSubscriber, m_saveChanges);
+            m_currentCollisionMap->changes().take(m_collisionSaveSubscriber, m_saveChanges);
+        }
+
+        // replay the journal of the map at mapPath into the current map and record further edits in it
+        // the current map has to be the one loaded from mapPath
+
+        void openJournal(const std::string& mapPath)
+        {
+            if (!m_currentTileMap) throw std::runtime_error("openJournal: tried to open a journal without an active map!");
+
+            const std::string path = mapPath + journalExtension;
+
+            for (const JournalRecord& record : EditJournal::read(path))
+            {
+                const int index = (int)record.index;
+
+                if (record.layer == JournalLayer::TILE && m_currentTileMap->indexValid(index) && record.value <= (uint8_t)TileType::ROAD)
+                {
+                    m_currentTileMap->setTileType(index, static_cast<TileType>(record.value));
+                }
+                else if (record.layer == JournalLayer::COLLISION && m_currentCollisionMap->indexValid(index))
+                {
+                    m_currentCollisionMap->setCollision(index, record.value != 0);
+                }
+            }
+
+            // replayed edits are already on disk
+
+            m_currentTileMap->changes().take(m_tileSaveSubscriber, m_saveChanges);
+            m_currentCollisionMap->changes().take(m_collisionSaveSubscriber, m_saveChanges);
+
+            m_journal = std::make_unique<EditJournal>(path);
+            m_journalMapPath = mapPath;
+        }
+
+        // write the current map into the journaled map file and empty the journal
+        // the map is saved next to the original and renamed over it, so a crash leaves either the old map
+        // with its journal or the new map, replaying the journal on the new map changes nothing
+
+        void rewriteJournaledMap()
+        {
+            const std::filesystem::path mapPath = m_journalMapPath;
+            const std::filesystem::path tempPath = mapPath.parent_path() / (".tmp-" + mapPath.filename().string());
+
+            saveMap(tempPath.string());
+            std::filesystem::rename(tempPath, mapPath);
+
+            m_journal->clear();
+        }
+
+        // append the edits since the last call to the journal, only changed cells are written
+        // a layer that changed as a whole (resized) has no cell list, the whole map is written instead
+
+        void writeJournal()
+        {
+            if (!m_journal) return;
+
+            m_currentTileMap->changes().take(m_tileSaveSubscriber, m_saveChanges);
+            if (m_saveChanges.all) return rewriteJournaledMap();
+
+            for (int index : m_saveChanges.indices)
+            {
+                m_journal->append(JournalLayer::TILE, index, (uint8_t)m_currentTileMap->getTile(index)->type);
+            }
+
+            m_currentCollisionMap->changes().take(m_collisionSaveSubscriber, m_saveChanges);
+            if (m_saveChanges.all) return rewriteJournaledMap();
+
+            for (int index : m_saveChanges.indices)
+            {
+                m_journal->append(JournalLayer::COLLISION, index, m_currentCollisionMap->getRect(index) ? 1 : 0);
+            }
+
+            m_journal->flush();
+        }
+
+        // write the journaled edits into the map file and empty the journal
+
+        void compactJournal()
+        {
+            if (!m_journal) return;
+
+            writeJournal();
+            if (m_journal->records() == 0) return;
+
+            rewriteJournaledMap();
+        }
+
+        // full save of the map at mapPath for when its journal failed, the journal is closed and removed
+        // since its records are older than the saved map, replaying them on the next load would undo later edits
+
+        void saveMapWithoutJournal(const std::string& mapPath)
+        {
+            saveMap(mapPath);
+
+            m_journal.reset();
+            std::filesystem::remove(mapPath + journalExtension);
+        }
+
+        size_t journalRecords() const {return m_journal ? m_journal->records() : 0;}
+
+        // free gpu resources of the current map, has to happen before the window closes
+
+        void unloadTextures()
+        {
+            if (m_currentTileMap) m_currentTileMap->unloadTextures();
+            if (m_currentDecalMap) m_currentDecalMap->unloadTextures();
+        }
+
+        // convert between text and binary maps, the output format follows the extension of to
+
+        static void convertMap(const std::string& from, const std::string& to, int tileWidth, int tileHeight)
+        {
+            MapManager mapManager;
+            mapManager.loadMap(from, tileWidth, tileHeight);
+            mapManager.saveMap(to);
         }
 
         TileMap* tileMap() const {return m_currentTileMap.get();}
         CollisionMap* collisionMap() const {return m_currentCollisionMap.get();}
+        DecalMap* decalMap() const {return m_currentDecalMap.get();}
     };
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// read only memory mapped file, the platform code lives in src/MappedFile.cpp,
+// because windows.h collides with raylib names
+
+class MappedFile
+{
+private:
+    const uint8_t* m_data{nullptr};
+    size_t m_size{0};
+
+#ifdef _WIN32
+    void* m_file{nullptr};
+    void* m_mapping{nullptr};
+#else
+    int m_fd{-1};
+#endif
+
+public:
+    // throws std::runtime_error when the file cant be opened or mapped
+
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const {return m_data;}
+    size_t size() const {return m_size;}
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include "Car.hpp"
+#include "AIDriver.hpp"
+#include "CarGrid.hpp"
+#include "InputSource.hpp"
+#include "JobSystem.hpp"
+#include "MapManager.hpp"
+#include "SimStats.hpp"
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+// the player car and the ai opponents on the current map, with the simulation tick
+// the game and the headless replay both drive it, so a recorded session gives the same trajectories in both
+
+class Race
+{
+private:
+    Car m_player;
+    std::vector<Car> m_aiCars;
+    std::vector<AIDriver> m_drivers;
+
+    Collision::CarGrid m_grid;
+
+    std::vector<Collision::OrientedBox> m_boxes;
+    std::vector<Vector2> m_vels;
+
+    static Vector2 mapCenter(Map::MapManager* mapManager, int tileWidth, int tileHeight)
+    {
+        return {mapManager->tileMap()->width() * tileWidth * 0.5f, mapManager->tileMap()->height() * tileHeight * 0.5f};
+    }
+
+    // push overlapping cars apart, the player is box 0 and the ai cars follow
+
+    size_t resolveCarCollisions()
+    {
+        m_boxes.clear();
+        m_vels.clear();
+
+        m_boxes.push_back(m_player.getBox());
+        m_vels.push_back(m_player.getVel());
+
+        for (const Car& aiCar : m_aiCars)
+        {
+            m_boxes.push_back(aiCar.getBox());
+            m_vels.push_back(aiCar.getVel());
+        }
+
+        const size_t contacts = Collision::resolveBoxes(m_grid, m_boxes, m_vels, {});
+        if (contacts == 0) return 0;
+
+        m_player.setBox(m_boxes[0], m_vels[0]);
+        for (size_t i = 0; i < m_aiCars.size(); ++i) m_aiCars[i].setBox(m_boxes[i + 1], m_vels[i + 1]);
+
+        return contacts;
+    }
+
+    void addAiCar(Vector2 pos, const std::vector<Vector2>& waypoints, const std::function<Car(Vector2)>& makeCar)
+    {
+        m_aiCars.push_back(makeCar(pos));
+        m_aiCars.back().setLogDrifts(false);
+        m_drivers.emplace_back(waypoints, pos);
+    }
+
+public:
+    // the player starts in the map center, the ai cars in rows behind it, makeCar builds a car at a position
+    // the distance field of the collision map is turned on, the ai looks ahead with it
+
+    Race(Map::MapManager* mapManager, int tileWidth, int tileHeight, int aiCarCount, const std::function<Car(Vector2)>& makeCar)
+        : m_player(makeCar(mapCenter(mapManager, tileWidth, tileHeight)))
+        , m_grid(tileWidth, mapManager->tileMap()->width() * tileWidth, mapManager->tileMap()->height() * tileHeight)
+    {
+        mapManager->collisionMap()->enableDistanceField();
+
+        const Vector2 startPos = mapCenter(mapManager, tileWidth, tileHeight);
+        const Vector2 size = Vector2Scale(m_player.getBox().halfSize, 2.f);
+        const std::vector<Vector2> waypoints = roadWaypoints(mapManager->tileMap(), tileWidth, tileHeight);
+
+        m_aiCars.reserve(aiCarCount);
+        m_drivers.reserve(aiCarCount);
+
+        for (int i = 0; i < aiCarCount; ++i)
+        {
+            const Vector2 pos = {startPos.x + (i % 3 - 1) * size.x * 1.5f, startPos.y + (i / 3 + 1) * size.y * 1.3f};
+            addAiCar(pos, waypoints, makeCar);
+        }
+    }
+
+    // the player starts at the first of startPositions and an ai car at each of the others (at least one position)
+    // for maps without road tiles to take the start and the waypoints from, like the generated benchmark tracks
+
+    Race(Map::MapManager* mapManager, int tileWidth, int tileHeight, const std::vector<Vector2>& startPositions, 
+         const std::vector<Vector2>& waypoints, const std::function<Car(Vector2)>& makeCar)
+        : m_player(makeCar(startPositions.front()))
+        , m_grid(tileWidth, mapManager->tileMap()->width() * tileWidth, mapManager->tileMap()->height() * tileHeight)
+    {
+        mapManager->collisionMap()->enableDistanceField();
+
+        m_aiCars.reserve(startPositions.size() - 1);
+        m_drivers.reserve(startPositions.size() - 1);
+
+        for (size_t i = 1; i < startPositions.size(); ++i) addAiCar(startPositions[i], waypoints, makeCar);
+    }
+
+    // waypoints for the ai, the centers of the road tiles ordered by their angle around the map center
+
+    static std::vector<Vector2> roadWaypoints(Map::TileMap* tileMap, int tileWidth, int tileHeight)
+    {
+        const Vector2 center = {tileMap->width() * tileWidth * 0.5f, tileMap->height() * tileHeight * 0.5f};
+        std::vector<Vector2> waypoints;
+
+        for (int i = 0; i < tileMap->width() * tileMap->height(); ++i)
+        {
+            const Map::Tile* tile = tileMap->getTile(i);
+            if (!tile || tile->type != Map::TileType::ROAD) continue;
+
+            const Vector2 pos = Vector2Add(tileMap->getWorldPos(i), {tileWidth * 0.5f, tileHeight * 0.5f});
+            if (Vector2Distance(pos, center) > tileWidth) waypoints.push_back(pos);
+        }
+
+        std::sort(waypoints.begin(), waypoints.end(), [center](Vector2 a, Vector2 b)
+        {
+            return atan2f(a.y - center.y, a.x - center.x) < atan2f(b.y - center.y, b.x - center.x);
+        });
+
+        return waypoints;
+    }
+
+    // one fixed tick: the player and the ai cars drive and hit the walls in parallel, every car only changes
+    // itself and reads the map, car against car and the decals are shared, so they run after the join
+
+    void tick(const float dt, Map::MapManager* mapManager, InputSource* input, JobSystem* jobs, SimStats* stats = nullptr)
+    {
+        simulate(dt, mapManager, input, jobs, stats);
+        bakeTrails(mapManager);
+    }
+
+    // the cars of one tick without the decals, the trajectories only depend on this
+    // the game bakes the trails once per frame after its ticks, expired trails wait in the car until then
+
+    void simulate(const float dt, Map::MapManager* mapManager, InputSource* input, JobSystem* jobs, SimStats* stats = nullptr)
+    {
+        drive(dt, mapManager, input, jobs, stats);
+        collideCars(stats);
+
+        if (stats)
+        {
+            ++stats->ticks;
+            stats->simulatedSeconds += dt;
+        }
+    }
+
+    // the stages of a tick, in this order, tick() runs them all, a job graph can run them as separate jobs
+
+    void drive(const float dt, Map::MapManager* mapManager, InputSource* input, JobSystem* jobs, SimStats* stats = nullptr)
+    {
+        const Map::CollisionMap& colMap = *mapManager->collisionMap();
+
+        m_player.input(*input, dt);
+
+        jobs->parallelFor(m_aiCars.size() + 1, [&](size_t i)
+        {
+            Car& car = i == 0 ? m_player : m_aiCars[i - 1];
+            if (i > 0) car.applyInput(m_drivers[i - 1].decide(car.getPos(), car.getRotation(), car.getVel(), colMap), dt);
+
+            car.update(dt, mapManager, stats);
+
+            const auto collisionStart = stats ? SimStats::now() : std::chrono::steady_clock::time_point{};
+            car.resolveCollision(colMap);
+            if (stats) SimStats::add(stats->collisionNanoseconds, collisionStart);
+        });
+    }
+
+    size_t collideCars(SimStats* stats = nullptr)
+    {
+        const auto collisionStart = stats ? SimStats::now() : std::chrono::steady_clock::time_point{};
+        const size_t contacts = resolveCarCollisions();
+        if (stats) SimStats::add(stats->collisionNanoseconds, collisionStart);
+
+        return contacts;
+    }
+
+    void bakeTrails(Map::MapManager* mapManager)
+    {
+        m_player.bakeTrails(mapManager);
+        for (Car& aiCar : m_aiCars) aiCar.bakeTrails(mapManager);
+    }
+
+    Car& player() {return m_player;}
+    std::vector<Car>& aiCars() {return m_aiCars;}
+    const std::vector<AIDriver>& drivers() const {return m_drivers;}
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+// draw calls and vertices submitted in one frame, reset at the start of every frame
+
+struct RenderStats
+{
+    int drawCalls{0};
+    int vertices{0};
+
+    void reset()
+    {
+        drawCalls = 0;
+        vertices = 0;
+    }
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <iomanip>
+
+// time spent in the simulation stages, summed over ticks and over the threads cars update on
+// only measured when a SimStats is passed in, reset before a measurement
+
+struct SimStats
+{
+    std::atomic<int64_t> updateNanoseconds{0};
+    std::atomic<int64_t> trailNanoseconds{0};
+    std::atomic<int64_t> collisionNanoseconds{0};
+
+    long long ticks{0};
+    double simulatedSeconds{0.0};
+
+    void reset()
+    {
+        updateNanoseconds = 0;
+        trailNanoseconds = 0;
+        collisionNanoseconds = 0;
+        ticks = 0;
+        simulatedSeconds = 0.0;
+    }
+
+    static std::chrono::steady_clock::time_point now() {return std::chrono::steady_clock::now();}
+
+    static void add(std::atomic<int64_t>& total, std::chrono::steady_clock::time_point start)
+    {
+        total += std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start).count();
+    }
+
+    static double seconds(const std::atomic<int64_t>& total) {return total * 1e-9;}
+
+    // simulated seconds per wall second of the whole run and of every stage alone, the stage times
+    // are summed over all cars, so they show the cost per stage and not how well it spreads over threads
+
+    void print(std::ostream& out, double wallSeconds) const
+    {
+        auto line = [&](const char* name, double seconds)
+        {
+            out << "  " << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(3) << std::setw(10) << seconds * 1000.0 
+                << " ms" << std::setprecision(1) << std::setw(14) << (seconds > 0.0 ? simulatedSeconds / seconds : 0.0) << " sim s/s" << std::endl;
+        };
+
+        out << "ticks: " << ticks << ", simulated: " << std::fixed << std::setprecision(2) << simulatedSeconds << " s" << std::endl;
+        line("total", wallSeconds);
+        line("Car::update", seconds(updateNanoseconds));
+        line("  TrailManager::addTrail", seconds(trailNanoseconds));
+        line("collision", seconds(collisionNanoseconds));
+        out << std::defaultfloat;
+    }
+};
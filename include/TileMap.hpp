@@ -2,7 +2,12 @@
 
 #include <raylib.h>
 
+#include "RenderStats.hpp"
+#include "ChangeTracker.hpp"
+
 #include <vector>
+#include <cstdint>
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <fstream>
@@ -25,6 +30,18 @@ namespace Map
         bool hovered;
     };  
 
+    // cached image of chunkSize x chunkSize tiles, one texel per tile, rebuilt only when a tile in it changed
+    // pixels can be filled ahead by prepareChunks, render then only uploads them
+
+    struct TileChunk
+    {
+        Texture2D texture{};
+        bool dirty{true};
+
+        std::vector<Color> pixels;
+        bool pixelsReady{false};
+    };
+
     class TileMap
     {
     private:
@@ -36,6 +53,142 @@ namespace Map
 
         std::vector<Tile> m_tileMap;
 
+        // changed tiles, the chunk cache is one of the subscribers
+
+        ChangeTracker m_changes;
+        int m_renderSubscriber;
+        ChangeSet m_renderChanges;
+
+        int m_hoveredIndex{-1};
+
+        static constexpr int chunkSize = 32;
+
+        int m_chunksX{0};
+        int m_chunksY{0};
+
+        std::vector<TileChunk> m_chunks;
+
+        // textures of chunks a smaller layout dropped, taken again by new chunks and freed by unloadTextures
+
+        std::vector<Texture2D> m_spareTextures;
+
+        void resetChunks()
+        {
+            // all chunk textures have the same size, so existing ones are reused when the layout changes
+
+            m_chunksX = (m_mapWidth + chunkSize - 1) / chunkSize;
+            m_chunksY = (m_mapHeight + chunkSize - 1) / chunkSize;
+
+            // chunks dropped by a smaller layout keep their textures in the spares, resize would leak them
+
+            for (size_t i = (size_t)(m_chunksX * m_chunksY); i < m_chunks.size(); ++i)
+            {
+                if (m_chunks[i].texture.id != 0) m_spareTextures.push_back(m_chunks[i].texture);
+            }
+
+            m_chunks.resize(m_chunksX * m_chunksY);
+
+            for (auto& chunk : m_chunks)
+            {
+                chunk.dirty = true;
+                chunk.pixelsReady = false;
+            }
+        }
+
+        static Color tileColor(TileType type)
+        {
+            switch (type)
+            {
+            case TileType::ROAD: return DARKGRAY;
+            case TileType::NONE: return LIGHTGRAY;
+            }
+            return LIGHTGRAY;
+        }
+
+        // cpu part of a rebuild, no gpu calls
+
+        void fillChunkPixels(int chunkX, int chunkY)
+        {
+            TileChunk& chunk = m_chunks[chunkY * m_chunksX + chunkX];
+            chunk.pixels.resize(chunkSize * chunkSize);
+
+            for (int y = 0; y < chunkSize; ++y)
+            {
+                for (int x = 0; x < chunkSize; ++x)
+                {
+                    int i = getIndexTilePos({(float)(chunkX * chunkSize + x), (float)(chunkY * chunkSize + y)});
+                    chunk.pixels[y * chunkSize + x] = indexValid(i) ? tileColor(m_tileMap[i].type) : BLANK;
+                }
+            }
+
+            chunk.pixelsReady = true;
+        }
+
+        void rebuildChunk(int chunkX, int chunkY)
+        {
+            TileChunk& chunk = m_chunks[chunkY * m_chunksX + chunkX];
+
+            if (!chunk.pixelsReady) fillChunkPixels(chunkX, chunkY);
+            Color* pixels = chunk.pixels.data();
+
+            if (chunk.texture.id == 0 && !m_spareTextures.empty())
+            {
+                chunk.texture = m_spareTextures.back();
+                m_spareTextures.pop_back();
+            }
+
+            if (chunk.texture.id == 0)
+            {
+                Image image{pixels, chunkSize, chunkSize, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+                chunk.texture = LoadTextureFromImage(image);
+                SetTextureFilter(chunk.texture, TEXTURE_FILTER_POINT);
+            }
+            else UpdateTexture(chunk.texture, pixels);
+
+            chunk.dirty = false;
+            chunk.pixelsReady = false;
+        }
+
+        // mark chunks of changed tiles, everything after a load
+
+        void markChangedChunks()
+        {
+            m_changes.take(m_renderSubscriber, m_renderChanges);
+
+            if (m_renderChanges.all)
+            {
+                for (auto& chunk : m_chunks) 
+                {
+                    chunk.dirty = true;
+                    chunk.pixelsReady = false;
+                }
+            }
+
+            for (int index : m_renderChanges.indices)
+            {
+                Vector2 tilePos = getTilePos(index);
+                TileChunk& chunk = m_chunks[((int)tilePos.y / chunkSize) * m_chunksX + (int)tilePos.x / chunkSize];
+                chunk.dirty = true;
+                chunk.pixelsReady = false;
+            }
+        }
+
+        // chunks in view of the camera, inclusive
+
+        void visibleChunks(Camera2D& cam, int& firstChunkX, int& firstChunkY, int& lastChunkX, int& lastChunkY) const
+        {
+            Vector2 topLeft = GetScreenToWorld2D({0.f, 0.f}, cam);
+            Vector2 bottomRight = GetScreenToWorld2D({(float)GetScreenWidth(), (float)GetScreenHeight()}, cam);
+
+            const float chunkWorldWidth = (float)(chunkSize * m_tileWidth);
+            const float chunkWorldHeight = (float)(chunkSize * m_tileHeight);
+
+            firstChunkX = (int)fmaxf(floorf(topLeft.x / chunkWorldWidth), 0.f);
+            firstChunkY = (int)fmaxf(floorf(topLeft.y / chunkWorldHeight), 0.f);
+            lastChunkX = (int)fminf(floorf(bottomRight.x / chunkWorldWidth), (float)m_chunksX - 1);
+            lastChunkY = (int)fminf(floorf(bottomRight.y / chunkWorldHeight), (float)m_chunksY - 1);
+        }
+
     public:
         TileMap(int tileWidth, int tileHeight, int mapWidth, int mapHeight)
             : m_tileWidth(tileWidth)
@@ -53,8 +206,15 @@ namespace Map
                 tile.hovered = false;
                 m_tileMap[i] = tile;
             }
+
+            m_changes.resize(m_mapWidth, m_mapHeight);
+            m_renderSubscriber = m_changes.subscribe();
+
+            resetChunks();
         }
 
+        // chunk textures have to be unloaded with unloadTextures while the window is open
+
         ~TileMap() = default;
 
         // overwrite current tilemap with new tilemap
@@ -74,6 +234,32 @@ namespace Map
                 tile.hovered = false;
                 m_tileMap[i] = tile;
             }
+
+            m_hoveredIndex = -1;
+            m_changes.resize(m_mapWidth, m_mapHeight);
+            resetChunks();
+        }
+
+        // overwrite current tilemap with one byte per tile, used by the binary map format
+
+        void loadLayer(const uint8_t* types, int mapWidth, int mapHeight)
+        {
+            m_mapWidth = mapWidth;
+            m_mapHeight = mapHeight;
+
+            m_tileMap.resize(m_mapWidth * m_mapHeight);
+
+            for (int i = 0; i < m_mapWidth * m_mapHeight; ++i)
+            {
+                Tile& tile = m_tileMap[i];
+                tile.worldPos = getWorldPos(i);
+                tile.type = static_cast<TileType>(types[i]);
+                tile.hovered = false;
+            }
+
+            m_hoveredIndex = -1;
+            m_changes.resize(m_mapWidth, m_mapHeight);
+            resetChunks();
         }
 
         // save tilemap as vector of int, wich represent tiletype
@@ -91,27 +277,112 @@ namespace Map
             return tileMap;
         }
 
-        // update
+        // update, only the previously and newly hovered tile are touched
 
         void update(Camera2D& cam)
         {
-            for (int i = 0; i < m_mapWidth * m_mapHeight; ++i)
+            Vector2 mousePos = GetScreenToWorld2D(GetMousePosition(), cam);
+            int mouseIndex = getIndexWorldPos(mousePos);
+
+            if (mouseIndex == m_hoveredIndex) return;
+
+            if (indexValid(m_hoveredIndex)) m_tileMap[m_hoveredIndex].hovered = false;
+            if (indexValid(mouseIndex)) m_tileMap[mouseIndex].hovered = true;
+
+            m_hoveredIndex = mouseIndex;
+        }
+
+        // change the type of a tile, every change goes through here so subscribers of changes() see it
+
+        void setTileType(int index, TileType type)
+        {
+            if (!indexValid(index) || m_tileMap[index].type == type) return;
+
+            m_tileMap[index].type = type;
+            m_changes.markDirty(index);
+        }
+
+        ChangeTracker& changes() {return m_changes;}
+
+        // fill the pixels of dirty chunks in view without touching the gpu, so it can run on a job thread
+        // while nothing edits the map, chunks that scroll into view later are still built by render
+
+        void prepareChunks(Camera2D& cam)
+        {
+            markChangedChunks();
+
+            int firstChunkX, firstChunkY, lastChunkX, lastChunkY;
+            visibleChunks(cam, firstChunkX, firstChunkY, lastChunkX, lastChunkY);
+
+            for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY)
             {
-                Tile& tile = m_tileMap[i];
-                tile.hovered = false;
+                for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX)
+                {
+                    const TileChunk& chunk = m_chunks[chunkY * m_chunksX + chunkX];
+                    if (chunk.dirty && !chunk.pixelsReady) fillChunkPixels(chunkX, chunkY);
+                }
             }
+        }
 
-            Vector2 mousePos = GetScreenToWorld2D(GetMousePosition(), cam);
-            int mouseIndex = getIndexWorldPos(mousePos);
-            if (indexValid(mouseIndex))
+        // render visible chunks, one textured quad each, and the hovered tile on top
+
+        void render(Camera2D& cam, RenderStats* stats = nullptr)
+        {
+            markChangedChunks();
+
+            const float chunkWorldWidth = (float)(chunkSize * m_tileWidth);
+            const float chunkWorldHeight = (float)(chunkSize * m_tileHeight);
+
+            int firstChunkX, firstChunkY, lastChunkX, lastChunkY;
+            visibleChunks(cam, firstChunkX, firstChunkY, lastChunkX, lastChunkY);
+
+            for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY)
             {
-                m_tileMap[mouseIndex].hovered = true;
+                for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX)
+                {
+                    if (m_chunks[chunkY * m_chunksX + chunkX].dirty) rebuildChunk(chunkX, chunkY);
+
+                    // edge chunks only draw the tiles inside the map
+
+                    const int tilesX = std::min(chunkSize, m_mapWidth - chunkX * chunkSize);
+                    const int tilesY = std::min(chunkSize, m_mapHeight - chunkY * chunkSize);
+
+                    DrawTexturePro(m_chunks[chunkY * m_chunksX + chunkX].texture,
+                        {0.f, 0.f, (float)tilesX, (float)tilesY},
+                        {chunkX * chunkWorldWidth, chunkY * chunkWorldHeight, (float)(tilesX * m_tileWidth), (float)(tilesY * m_tileHeight)},
+                        {0.f, 0.f}, 0.f, WHITE);
+
+                    if (stats)
+                    {
+                        stats->drawCalls++;
+                        stats->vertices += 4;
+                    }
+                }
+            }
+
+            if (indexValid(m_hoveredIndex))
+            {
+                DrawRectangleV(m_tileMap[m_hoveredIndex].worldPos, {(float)m_tileWidth, (float)m_tileHeight}, ORANGE);
             }
         }
 
-        // render
+        void unloadTextures()
+        {
+            for (auto& chunk : m_chunks)
+            {
+                if (chunk.texture.id == 0) continue;
+                UnloadTexture(chunk.texture);
+                chunk.texture = {};
+                chunk.dirty = true;
+            }
+
+            for (Texture2D& texture : m_spareTextures) UnloadTexture(texture);
+            m_spareTextures.clear();
+        }
+
+        // render every visible tile on its own, without the chunk cache, kept to compare in the benchmark
 
-        void render(Camera2D& cam)
+        void renderImmediate(Camera2D& cam, RenderStats* stats = nullptr)
         {
             Vector2 topLeftScreen = {0.f, 0.f};
             Vector2 topLeft = GetScreenToWorld2D(topLeftScreen, cam);
@@ -149,6 +420,12 @@ namespace Map
                     {
                         DrawRectangleV(tile.worldPos, {(float)m_tileWidth, (float)m_tileHeight}, ORANGE);
                     }
+
+                    if (stats)
+                    {
+                        stats->drawCalls++;
+                        stats->vertices += 4;
+                    }
                 }
             }
         }
@@ -191,7 +468,9 @@ namespace Map
             return getWorldPos(tilePos);
         }
 
-        Tile* getTile(int index)
+        // read only, change tiles with setTileType
+
+        const Tile* getTile(int index)
         {
             if (!indexValid(index)) return nullptr;
             return &m_tileMap[index];
@@ -2,32 +2,171 @@
 
 #include <raylib.h>
 #include <raymath.h>
+#include <rlgl.h>
+
+#include "RenderStats.hpp"
+#include "DecalMap.hpp"
 
 #include <vector>
-#include <deque>
 #include <iomanip>
 
+// one straight piece of a tyre strip as a quad, corners are built when the piece is added or extended
+// and drawn as they are
+
 struct Trail
 {
-    Rectangle rectangle{};
-    float rotation{};
+    Vector2 corners[4]{};
 };
 
+// open strip of one wheel, its last piece is extended while the wheel keeps its direction
+
+struct WheelStrip
+{
+    bool active{false};
+    size_t serial{};
+    Vector2 start{};
+    Vector2 last{};
+    Vector2 direction{};
+};
+
+// preallocated ring buffer of trails, the oldest trail is overwritten when full
+// the ring is the vertex stream for rendering, so all trails are drawn with a few batched submissions
+// overwritten trails are kept until bakeExpired draws them into the map decals
+
 class TrailManager
 {
 private:
-    std::deque<Trail> m_trails;
+    std::vector<Trail> m_trails;
+    size_t m_head{0};
+    size_t m_count{0};
+
+    // overwritten trails waiting to be baked, bounded by maxTrails, older ones are dropped if nobody bakes
+
+    std::vector<Trail> m_expired;
+
+    // number of trails ever pushed, trail n is stored at n % maxTrails while it is alive
+
+    size_t m_serial{0};
+    size_t m_marks{0};
+
+    WheelStrip m_strips[4];
 
     float m_trailTime{};
     float m_trailCounter{};
     size_t m_maxTrails{};
 
+    // a new piece only starts when the direction turns more than this (cos of ~5 deg) or after a gap
+
+    const float m_straightCos{0.996f};
+    const float m_maxGap{64.f};
+
+    size_t push(const Trail& trail)
+    {
+        if (m_maxTrails == 0) return m_serial++;
+
+        if (m_count < m_maxTrails)
+        {
+            size_t i = m_head + m_count;
+            if (i >= m_maxTrails) i -= m_maxTrails;
+            m_trails[i] = trail;
+            ++m_count;
+        }
+        else
+        {
+            if (m_expired.size() < m_maxTrails) m_expired.push_back(m_trails[m_head]);
+            m_trails[m_head] = trail;
+            if (++m_head == m_maxTrails) m_head = 0;
+        }
+
+        return m_serial++;
+    }
+
+    Trail* find(size_t serial)
+    {
+        if (m_maxTrails == 0 || serial + m_count < m_serial) return nullptr;
+        return &m_trails[serial % m_maxTrails];
+    }
+
+    // quad from start to end with width, caps reach half a width past both ends, so a single point is a square
+    // corners have the same winding as DrawRectanglePro
+
+    static Trail buildPiece(Vector2 start, Vector2 end, Vector2 direction, float width)
+    {
+        const float half = width * 0.5f;
+        const Vector2 along = Vector2Scale(direction, half);
+        const Vector2 right = {direction.y * half, -direction.x * half};
+
+        const Vector2 from = Vector2Subtract(start, along);
+        const Vector2 to = Vector2Add(end, along);
+
+        Trail trail;
+        trail.corners[0] = Vector2Subtract(from, right);
+        trail.corners[1] = Vector2Subtract(to, right);
+        trail.corners[2] = Vector2Add(to, right);
+        trail.corners[3] = Vector2Add(from, right);
+        return trail;
+    }
+
+    void addMark(WheelStrip& strip, Vector2 pos, Vector2 back, float width)
+    {
+        ++m_marks;
+
+        Trail* piece = strip.active ? find(strip.serial) : nullptr;
+        const Vector2 step = Vector2Subtract(pos, strip.last);
+        const float stepLength = Vector2Length(step);
+
+        if (piece && stepLength <= m_maxGap)
+        {
+            if (stepLength < 1e-3f) return;
+
+            const Vector2 stepDirection = Vector2Scale(step, 1.f / stepLength);
+
+            // piece is still a single point: give it its direction
+
+            if (strip.start == strip.last)
+            {
+                strip.direction = stepDirection;
+                strip.last = pos;
+                *piece = buildPiece(strip.start, pos, stepDirection, width);
+                return;
+            }
+
+            // straight on: move the end of the last piece
+
+            if (Vector2DotProduct(stepDirection, strip.direction) >= m_straightCos)
+            {
+                strip.last = pos;
+                *piece = buildPiece(strip.start, pos, strip.direction, width);
+                return;
+            }
+
+            // turned: new piece joined to the last one
+
+            strip.serial = push(buildPiece(strip.last, pos, stepDirection, width));
+            strip.start = strip.last;
+            strip.direction = stepDirection;
+            strip.last = pos;
+            return;
+        }
+
+        // gap or first mark: new strip starting with a square
+
+        strip.active = true;
+        strip.serial = push(buildPiece(pos, pos, back, width));
+        strip.start = pos;
+        strip.last = pos;
+        strip.direction = back;
+    }
+
 public:
     TrailManager(float trailTime, size_t maxTrails) 
-        : m_trailTime(trailTime)
+        : m_trails(maxTrails)
+        , m_trailTime(trailTime)
         , m_trailCounter(trailTime)
         , m_maxTrails(maxTrails)
-    {}
+    {
+        m_expired.reserve(maxTrails);
+    }
 
     ~TrailManager() = default;
 
@@ -38,7 +177,6 @@ public:
                 const Vector2& carSize,
                 const Vector2& carPos,
                 const Vector2& rotationOffset,
-                float rotation,
                 bool handBrake,
                 float dt)
     {
@@ -46,7 +184,15 @@ public:
 
         const bool drifting = (fabsf(sidewaysSpeed) > fabsf(forwardSpeed) * 0.5f);
 
-        if (!(drifting || (handBrake && forwardSpeed != 0.f)) || m_trailCounter > 0.0f) return;
+        // no marks this tick ends every strip, the next mark starts a new one
+
+        if (!(drifting || (handBrake && forwardSpeed != 0.f)))
+        {
+            for (auto& strip : m_strips) strip.active = false;
+            return;
+        }
+
+        if (m_trailCounter > 0.0f) return;
         
         m_trailCounter = m_trailTime;
 
@@ -55,26 +201,75 @@ public:
         const Vector2 rgtP = Vector2Scale(sideways,  carSize.x * 0.5f);
         const Vector2 lftP = Vector2Scale(sideways, -carSize.x * 0.5f);
 
-        std::vector<Vector2> positions;
-        positions.reserve(4);
-        positions.emplace_back(Vector2Add(Vector2Add(fwdP, rgtP), carPos));
-        positions.emplace_back(Vector2Add(Vector2Add(fwdP, lftP), carPos));
-        positions.emplace_back(Vector2Add(Vector2Add(bwdP, rgtP), carPos));
-        positions.emplace_back(Vector2Add(Vector2Add(bwdP, lftP), carPos));
-
-        for (auto pos : positions)
-        {   
-            Trail trail;
-            trail.rectangle = {pos.x, pos.y, carSize.x/8, carSize.x/8};
-            trail.rotation = rotation;
-            m_trails.push_back(trail);
-        }      
-
-        while (m_trails.size() > m_maxTrails) 
+        const Vector2 positions[4] = {
+            Vector2Add(Vector2Add(fwdP, rgtP), carPos),
+            Vector2Add(Vector2Add(fwdP, lftP), carPos),
+            Vector2Add(Vector2Add(bwdP, rgtP), carPos),
+            Vector2Add(Vector2Add(bwdP, lftP), carPos)
+        };
+
+        const Vector2 back = Vector2Negate(forward);
+
+        for (int i = 0; i < 4; ++i) addMark(m_strips[i], positions[i], back, carSize.x/8);
+    }
+
+    // rasterize overwritten trails into the decal map, they stay visible there for good
+
+    void bakeExpired(Map::DecalMap* decals, Color color)
+    {
+        if (decals)
+        {
+            for (const Trail& trail : m_expired) decals->bakeQuad(trail.corners, color);
+        }
+        m_expired.clear();
+    }
+
+    // draw all trails as quads, one submission per full render batch
+
+    void render(Color color, RenderStats* stats) const
+    {
+        const size_t batchQuads = RL_DEFAULT_BATCH_BUFFER_ELEMENTS;
+
+        bool open = false;
+        size_t inBatch = 0;
+
+        forEach([&](const Trail& trail)
         {
-            m_trails.pop_front();         
-        }  
+            if (!open || inBatch == batchQuads)
+            {
+                if (open) rlEnd();
+                rlCheckRenderBatchLimit(batchQuads * 4);
+                rlBegin(RL_QUADS);
+                rlColor4ub(color.r, color.g, color.b, color.a);
+                if (stats) stats->drawCalls++;
+                open = true;
+                inBatch = 0;
+            }
+
+            for (const Vector2& corner : trail.corners) rlVertex2f(corner.x, corner.y);
+            ++inBatch;
+        });
+
+        if (open) rlEnd();
+        if (stats) stats->vertices += (int)m_count * 4;
     }
 
-    const std::deque<Trail>* getTrails() const {return &m_trails;}
+    // visit all trails from oldest to newest, the ring is walked as two contiguous parts
+
+    template<typename Func>
+    void forEach(Func&& func) const
+    {
+        const size_t firstEnd = m_head + m_count < m_maxTrails ? m_head + m_count : m_maxTrails;
+        const size_t secondEnd = m_count - (firstEnd - m_head);
+
+        for (size_t i = m_head; i < firstEnd; ++i) func(m_trails[i]);
+        for (size_t i = 0; i < secondEnd; ++i) func(m_trails[i]);
+    }
+
+    size_t size() const {return m_count;}
+
+    // marks of single wheels added, each one used to be its own quad
+
+    size_t marks() const {return m_marks;}
+    size_t pieces() const {return m_serial;}
 };
\ No newline at end of file
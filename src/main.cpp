@@ -8,44 +8,71 @@
 #include <iostream>
 #include <vector>
 #include <deque>
+#include <algorithm>
 
 #include "../include/Car.hpp"
 #include "../include/MapManager.hpp"
+#include "../include/RenderStats.hpp"
+#include "../include/JobSystem.hpp"
+#include "../include/Race.hpp"
+#include "../include/CarSettings.hpp"
 
-void handleInput(const float dt, Car* car)
-{
-    car->input(dt);
-}
+// editor input runs once per frame, not per tick, so a click toggles a tile exactly once
 
-void update(const float dt, Map::MapManager* mapManager, Car* car, Camera2D& cam)
+void updateEditor(Map::MapManager* mapManager, Camera2D& cam)
 {
-    car->update(dt, mapManager);
-
     Vector2 mousePos = GetScreenToWorld2D(GetMousePosition(), cam);
     int mouseIndex = mapManager->tileMap()->getIndexWorldPos(mousePos);
 
     if (mapManager->tileMap()->indexValid(mouseIndex))
     {
-        Map::Tile* tile = mapManager->tileMap()->getTile(mouseIndex);
+        const Map::Tile* tile = mapManager->tileMap()->getTile(mouseIndex);
         if (tile && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) 
         {
-            if (tile->type == Map::TileType::NONE) tile->type = Map::TileType::ROAD;
-            else  tile->type = Map::TileType::NONE;
+            if (tile->type == Map::TileType::NONE) mapManager->tileMap()->setTileType(mouseIndex, Map::TileType::ROAD);
+            else mapManager->tileMap()->setTileType(mouseIndex, Map::TileType::NONE);
         }
     }
 
     mapManager->tileMap()->update(cam);
 }
 
-void render(Car* car, Map::MapManager* mapManager, Camera2D& cam)
+// timings of the frame jobs of the last frame, jobs on the critical path are marked
+
+void jobWindow(const JobSystem* jobs)
+{
+    const std::vector<JobSystem::JobId> criticalPath = jobs->criticalPath();
+
+    ImGui::Begin("Jobs");
+    ImGui::Text("threads: %i", (int)jobs->threadCount());
+
+    for (JobSystem::JobId id = 0; id < jobs->timings().size(); ++id)
+    {
+        const JobSystem::JobTiming& timing = jobs->timings()[id];
+        const bool critical = std::find(criticalPath.begin(), criticalPath.end(), id) != criticalPath.end();
+
+        ImGui::Text("%s %-14s thread %i  %7.3f - %7.3f ms  (%.3f ms)", critical ? "*" : " ", timing.name.c_str(), timing.thread, 
+                    timing.start, timing.end, timing.end - timing.start);
+    }
+
+    ImGui::Text("* critical path");
+    ImGui::End();
+}
+
+void render(Car* car, std::vector<Car>* aiCars, Map::MapManager* mapManager, const JobSystem* jobs, Camera2D& cam, float alpha, RenderStats* stats)
 {
+    stats->reset();
+
     BeginDrawing();
     ClearBackground(GRAY);
 
+    cam.target = car->getRenderPos(alpha);
+
     BeginMode2D(cam);
-    mapManager->tileMap()->render(cam);
-    car->render(mapManager);
-    cam.target = car->getPos();
+    mapManager->tileMap()->render(cam, stats);
+    mapManager->decalMap()->render(cam, stats);
+    for (Car& aiCar : *aiCars) aiCar.render(alpha, stats);
+    car->render(alpha, stats);
     EndMode2D();
 
     float boostBarX = GetScreenWidth() * (float)80/100;
@@ -59,15 +86,124 @@ void render(Car* car, Map::MapManager* mapManager, Camera2D& cam)
     DrawRectangleLinesEx({boostBarX - 2.f, boostBarY - 2.f, boostBarFrameSize.x + 4.f, boostBarFrameSize.y + 4.f}, 2.f, BLACK);
     DrawRectangle(boostBarX, boostBarY, boostBarSize.x, boostBarSize.y, SKYBLUE);
 
+    DrawText(TextFormat("batched draw calls: %i, vertices: %i", stats->drawCalls, stats->vertices), 
+        boostBarX, boostBarY + boostBarFrameSize.y + 10.f, 20, BLACK);
+
     rlImGuiBegin();
 
     car->tuner();
+    jobWindow(jobs);
 
     rlImGuiEnd();
 
     EndDrawing();
 }
 
+// load a map on a worker thread and draw a progress bar meanwhile, false when loading failed or the window closed
+
+bool loadMapWithScreen(Map::MapManager* mapManager, const std::string& path, int tileWidth, int tileHeight)
+{
+    mapManager->loadMapAsync(path, tileWidth, tileHeight);
+
+    Map::LoadState state = Map::LoadState::LOADING;
+
+    while (state == Map::LoadState::LOADING && !WindowShouldClose())
+    {
+        state = mapManager->pollLoad();
+
+        const float barWidth = GetScreenWidth() * 0.5f;
+        const Vector2 barPos = {GetScreenWidth() * 0.25f, GetScreenHeight() * 0.5f};
+
+        BeginDrawing();
+        ClearBackground(DARKGRAY);
+        DrawText(TextFormat("Loading %s  %i%%", path.c_str(), (int)(mapManager->loadProgress() * 100.f)), (int)barPos.x, (int)barPos.y - 40, 30, RAYWHITE);
+        DrawRectangleV(barPos, {barWidth, 20.f}, GRAY);
+        DrawRectangleV(barPos, {barWidth * mapManager->loadProgress(), 20.f}, RAYWHITE);
+        EndDrawing();
+    }
+
+    if (state == Map::LoadState::FAILED)
+    {
+        std::cerr << mapManager->loadError() << std::endl;
+
+        while (!WindowShouldClose())
+        {
+            BeginDrawing();
+            ClearBackground(DARKGRAY);
+            DrawText(mapManager->loadError().c_str(), GetScreenWidth() / 4, GetScreenHeight() / 2, 30, RED);
+            EndDrawing();
+        }
+    }
+
+    return state == Map::LoadState::FINISHED;
+}
+
+// render a 1024x1024 map at several zoom levels, tile by tile and chunked, run with --bench-tilemap
+
+int runTileMapBenchmark(int screenWidth, int screenHeight)
+{
+    SetConfigFlags(FLAG_WINDOW_RESIZABLE);
+    InitWindow(screenWidth, screenHeight, "Racing Game - Tile Map Benchmark");
+    SetTargetFPS(0);
+
+    const int mapSize = 1024;
+    const int tileSize = 64;
+
+    Map::TileMap tileMap(tileSize, tileSize, mapSize, mapSize);
+    for (int i = 0; i < mapSize * mapSize; ++i)
+    {
+        if ((i % mapSize + i / mapSize) % 3 == 0) tileMap.setTileType(i, Map::TileType::ROAD);
+    }
+
+    Camera2D cam;
+    cam.offset = {(float)screenWidth/2, (float)screenHeight/2};
+    cam.rotation = 0.f;
+    cam.target = {mapSize * tileSize * 0.5f, mapSize * tileSize * 0.5f};
+
+    const float zooms[] = {1.f, 0.5f, 0.25f, 0.1f, 0.05f, 0.02f};
+    const int frames = 30;
+
+    RenderStats stats;
+
+    for (float zoom : zooms)
+    {
+        cam.zoom = zoom;
+
+        for (bool chunked : {false, true})
+        {
+            // one frame before timing, so chunk textures are built
+
+            double start = 0.0;
+
+            for (int frame = 0; frame <= frames; ++frame)
+            {
+                if (frame == 1) start = GetTime();
+
+                stats.reset();
+
+                BeginDrawing();
+                ClearBackground(GRAY);
+                BeginMode2D(cam);
+                if (chunked) tileMap.render(cam, &stats);
+                else tileMap.renderImmediate(cam, &stats);
+                EndMode2D();
+                EndDrawing();
+            }
+
+            const double ms = (GetTime() - start) * 1000.0 / frames;
+
+            std::cout << "zoom " << zoom << (chunked ? " chunked:  " : " per tile: ") 
+                      << std::fixed << std::setprecision(2) << ms << " ms/frame, " 
+                      << stats.drawCalls << " draw calls" << std::defaultfloat << std::endl;
+        }
+    }
+
+    tileMap.unloadTextures();
+    CloseWindow();
+
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     // set constant values
@@ -77,11 +213,87 @@ int main(int argc, char** argv)
 
     const char* title = "Racing Game";
 
+    // physics runs with a fixed tick rate, independent of the frame rate, set with --tick-rate <hz>
+
+    float tickRate = 120.f;
+
+    // computer cars, set with --ai-cars <n>, frame jobs run on --threads <n> threads (0 uses every core)
+
+    int aiCarCount = 3;
+    int threads = 0;
+
+    // --record <path> writes the inputs of every tick into an input log, --replay <path> drives with one
+    // instead of the keyboard, the editor is off for both since edits arent part of the log
+
+    std::string recordPath;
+    std::string replayPath;
+
+    // --fast runs a fixed batch of ticks every frame without vsync or fps cap, so replays play as fast as
+    // the cpu allows, throughput per stage is printed on exit
+
+    bool fast = false;
+
+    bool benchTileMap = false;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--tick-rate" && i + 1 < argc) tickRate = fmaxf(std::stof(argv[++i]), 1.f);
+            if (arg == "--ai-cars" && i + 1 < argc) aiCarCount = std::clamp(std::stoi(argv[++i]), 0, (int)InputLog::maxAiCars);
+            if (arg == "--threads" && i + 1 < argc) threads = std::max(std::stoi(argv[++i]), 0);
+            if (arg == "--record" && i + 1 < argc) recordPath = argv[++i];
+            if (arg == "--replay" && i + 1 < argc) replayPath = argv[++i];
+            if (arg == "--fast") fast = true;
+            if (arg == "--bench-tilemap") benchTileMap = true;
+        }
+
+        if (!std::isfinite(tickRate)) throw std::invalid_argument("tick rate");
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " [--tick-rate <hz>] [--ai-cars <n>] [--threads <n>] [--record <path> | --replay <path>] [--fast] [--bench-tilemap]" << std::endl;
+        return 1;
+    }
+
+    if (benchTileMap) return runTileMapBenchmark(screenWidth, screenHeight);
+
+    // a replay runs with the tick rate and ai cars of its recording, load rejects values out of range
+
+    InputLog replayLog;
+
+    if (!replayPath.empty())
+    {
+        try
+        {
+            replayLog = InputLog::load(replayPath);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+
+        tickRate = replayLog.tickRate();
+        aiCarCount = (int)replayLog.aiCars();
+    }
+
+    InputSource input = replayPath.empty() ? InputSource::keyboard() : InputSource::replay(replayLog);
+
+    InputLog recordLog(tickRate, (uint32_t)aiCarCount);
+    if (!recordPath.empty()) input.record(&recordLog);
+
+    const bool editorEnabled = recordPath.empty() && replayPath.empty();
+
+    const float fixedDt = 1.f / tickRate;
+    const float maxFrameTime = 0.25f;
+
     // init game
 
-    SetConfigFlags(FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT | FLAG_WINDOW_RESIZABLE);
+    SetConfigFlags(fast ? FLAG_WINDOW_RESIZABLE : FLAG_MSAA_4X_HINT | FLAG_VSYNC_HINT | FLAG_WINDOW_RESIZABLE);
     InitWindow(screenWidth, screenHeight, title);
-    SetTargetFPS(240);
+    SetTargetFPS(fast ? 0 : 240);
     rlImGuiSetup(true);
 
     // create car
@@ -95,45 +307,172 @@ int main(int argc, char** argv)
     std::string selectedMapPath = "data/map.txt";
 
     Map::MapManager mapManager;
-    mapManager.loadMap(selectedMapPath, tileWidth, tileHeight);
 
-    const float trailTime = 0.001f;
-    const size_t maxTrails = 100000;
+    if (!loadMapWithScreen(&mapManager, selectedMapPath, tileWidth, tileHeight))
+    {
+        rlImGuiShutdown();
+        CloseWindow();
+        return 1;
+    }
 
-    const float accelerationSpeed = 500.f;
-    const float decelerationSpeed = 400.f;
-    const float turnSpeed = 10.f;
+    // edits go to <map>.journal every frame, it is written into the map when it gets long and on exit
+    // a journal that cant be read or written is reported, the game goes on without it and saves the whole map on exit
 
-    const float rollFriction = 0.03f;
-    const float airFriction = 0.03f;
-    const float grip = 5.f;
+    const size_t maxJournalRecords = 4096;
+    bool journalEnabled = true;
 
-    const Vector2 startPos = {mapManager.tileMap()->width() * tileWidth * 0.5f, mapManager.tileMap()->height() * tileHeight * 0.5f};
-    const Vector2 size = {30.f, 60.f};
+    try
+    {
+        mapManager.openJournal(selectedMapPath);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << " edits are saved with the whole map on exit!" << std::endl;
+        journalEnabled = false;
+    }
+
+    // player and ai cars, the race also turns on the distance field that collision and the ai use
+
+    const CarSettings carSettings;
 
-    Car car(trailTime, maxTrails, accelerationSpeed, decelerationSpeed, 
-            turnSpeed, rollFriction, airFriction, grip, startPos, size, &vehicleTex);
+    Race race(&mapManager, tileWidth, tileHeight, aiCarCount, [&](Vector2 pos)
+    {
+        return carSettings.makeCar(pos, &vehicleTex);
+    });
+    race.player().setCollisionDebug(true);
+
+    Car& car = race.player();
 
     Camera2D cam;
     cam.offset = {(float)screenWidth/2, (float)screenHeight/2};
     cam.rotation = 0.f;
-    cam.target = startPos;
+    cam.target = car.getPos();
     cam.zoom = 1.f;
     
     // game loop
 
-    while (!WindowShouldClose())
+    float accumulator = 0.f;
+    float alpha = 0.f;
+    RenderStats renderStats;
+    SimStats simStats;
+
+    // stages of a frame, the editor runs before and render after them on the main thread, raylib only draws there
+    // the journal only reads the maps, so it runs next to the distance field and the simulation
+    // the ticks of a frame stay one job: how many there are depends on the accumulator and every tick needs the
+    // one before, the cars of a tick are spread over the threads with parallelFor inside Race::simulate
+    // the trails only feed the decals for render, so they are baked once per frame next to the tile chunks
+
+    JobSystem jobs(threads);
+
+    const JobSystem::JobId distanceFieldJob = jobs.add("distance field", [&]
+    {
+        mapManager.collisionMap()->updateDistanceField();
+    });
+
+    jobs.add("journal", [&]
+    {
+        if (!journalEnabled) return;
+
+        try
+        {
+            mapManager.writeJournal();
+            if (mapManager.journalRecords() >= maxJournalRecords) mapManager.compactJournal();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << " edits are saved with the whole map on exit!" << std::endl;
+            journalEnabled = false;
+        }
+    });
+
+    const JobSystem::JobId simulationJob = jobs.add("simulation", [&]
+    {
+        // clamp long frames, so physics doesnt spiral when the game hangs
+
+        accumulator += fast ? maxFrameTime : fminf(GetFrameTime(), maxFrameTime);
+
+        while (accumulator >= fixedDt && !input.finished())
+        {
+            race.simulate(fixedDt, &mapManager, &input, &jobs, fast ? &simStats : nullptr);
+            accumulator -= fixedDt;
+        }
+
+        alpha = accumulator / fixedDt;
+    }, {distanceFieldJob});
+
+    jobs.add("trails", [&]
+    {
+        race.bakeTrails(&mapManager);
+    }, {simulationJob});
+
+    jobs.add("tile chunks", [&]
+    {
+        Camera2D view = cam;
+        view.target = car.getRenderPos(alpha);
+        mapManager.tileMap()->prepareChunks(view);
+    }, {simulationJob});
+
+    const double startTime = GetTime();
+
+    while (!WindowShouldClose() && !input.finished())
     {   
-        const float dt = GetFrameTime();
+        if (editorEnabled) updateEditor(&mapManager, cam);
+
+        jobs.run();
 
-        handleInput(dt, &car);
-        update(dt, &mapManager, &car, cam);
-        render(&car, &mapManager, cam);
+        render(&car, &race.aiCars(), &mapManager, &jobs, cam, alpha, &renderStats);
     }
 
     // close game
 
-    mapManager.saveMap(selectedMapPath);
+    if (fast)
+    {
+        simStats.print(std::cout, GetTime() - startTime);
+    }
+
+    if (input.finished()) std::cout << "replay of " << replayLog.ticks() << " ticks finished" << std::endl;
+
+    if (!recordPath.empty())
+    {
+        try
+        {
+            recordLog.save(recordPath);
+            std::cout << "recorded " << recordLog.ticks() << " ticks in " << recordLog.runs().size() << " runs to " << recordPath << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    if (journalEnabled)
+    {
+        try
+        {
+            mapManager.compactJournal();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            journalEnabled = false;
+        }
+    }
+
+    // without a working journal the edits are only in memory, so the whole map is saved like before the journal
+
+    if (!journalEnabled)
+    {
+        try
+        {
+            mapManager.saveMapWithoutJournal(selectedMapPath);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    mapManager.unloadTextures();
     rlImGuiShutdown();
     CloseWindow();
 
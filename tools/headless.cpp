@@ -0,0 +1,1126 @@
+// headless simulation driver, runs the car physics without a window or gpu
+// build with "make headless", it does not link raylib
+//
+// racingGameHeadless [mapPath] [ticks] [tickRate]    drive one car with a script
+// racingGameHeadless bench-cars [carCount] [ticks]   Car objects against CarSystem
+// racingGameHeadless check-kernels [count]           SIMD kernels against the scalar and libm reference
+// racingGameHeadless convert <from> <to>             text map <-> binary map (.rgm), by extension of to
+// racingGameHeadless make-world <path> <w> <h>       write a streamed world (.rgw) with an oval track
+// racingGameHeadless stream <world> [ticks] [cars]   ai cars drive on the track, chunks stream in around them
+// racingGameHeadless bench-collision [cars] [ticks] [distanceField]  car against wall collision on an oval track
+// racingGameHeadless bench-broadphase [maxCars]      car against car pairs, grid against all pairs
+// racingGameHeadless bench-ai [cars] [ticks] [threads]  ai cars on an oval track as jobs, one thread against all
+// racingGameHeadless make-replay <log> [ticks] [aiCars] [tickRate]  record the default script as an input log (.rgin)
+// racingGameHeadless replay <log> [mapPath] [threads]  play an input log as fast as possible, throughput per stage
+
+#include <raylib.h>
+#include <raymath.h>
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include "../include/Car.hpp"
+#include "../include/CarSystem.hpp"
+#include "../include/CarGrid.hpp"
+#include "../include/MapManager.hpp"
+#include "../include/ChunkedWorld.hpp"
+#include "../include/AIDriver.hpp"
+#include "../include/Race.hpp"
+#include "../include/CarSettings.hpp"
+#include "../include/JobSystem.hpp"
+
+// same values as the game
+
+const int tileWidth = 64;
+const int tileHeight = 64;
+
+const CarSettings carSettings;
+const Vector2 size = carSettings.size;
+
+// the game car with fewer trails, for the many cars of the benchmarks
+
+CarSettings fewTrails(size_t maxTrails)
+{
+    CarSettings settings = carSettings;
+    settings.maxTrails = maxTrails;
+    return settings;
+}
+
+CarParams carParams()
+{
+    CarParams params{carSettings.accelerationSpeed, carSettings.decelerationSpeed, carSettings.turnSpeed, 
+                     carSettings.rollFriction, carSettings.airFriction, carSettings.grip, carSettings.grip/4};
+    params.size = carSettings.size;
+    return params;
+}
+
+struct ScriptStep
+{
+    float duration;
+    CarInput input;
+};
+
+// scripted driving, repeated until the simulation ends
+
+std::vector<ScriptStep> defaultScript()
+{
+    CarInput accelerate;
+    accelerate.forward = true;
+
+    CarInput turnRight = accelerate;
+    turnRight.right = true;
+
+    CarInput drift = accelerate;
+    drift.left = true;
+    drift.handBrake = true;
+
+    CarInput boost = accelerate;
+    boost.boost = true;
+
+    CarInput brake;
+    brake.backward = true;
+
+    return {
+        {2.0f, accelerate},
+        {1.5f, turnRight},
+        {1.0f, drift},
+        {1.0f, boost},
+        {0.5f, brake},
+        {1.0f, CarInput()}
+    };
+}
+
+// input of the script at a given time
+
+const CarInput& scriptInput(const std::vector<ScriptStep>& script, float time)
+{
+    float total = 0.f;
+    for (auto& step : script) total += step.duration;
+
+    time = fmodf(time, total);
+
+    for (auto& step : script)
+    {
+        if (time < step.duration) return step.input;
+        time -= step.duration;
+    }
+    return script.back().input;
+}
+
+// drive one car over a map with the default script and report ticks per second
+
+int runSimulation(int argc, char** argv)
+{
+    // read arguments: map path, tick count and tick rate
+
+    std::string selectedMapPath = "data/map.txt";
+    long long ticks = 100000;
+    float tickRate = 120.f;
+
+    try
+    {
+        if (argc > 1) selectedMapPath = argv[1];
+        if (argc > 2) ticks = std::stoll(argv[2]);
+        if (argc > 3) tickRate = std::stof(argv[3]);
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " [mapPath] [ticks] [tickRate]" << std::endl;
+        return 1;
+    }
+
+    if (ticks <= 0 || tickRate <= 0.f)
+    {
+        std::cerr << "headless: ticks and tickRate must be positive!" << std::endl;
+        return 1;
+    }
+
+    const float dt = 1.f / tickRate;
+
+    // load map
+
+    Map::MapManager mapManager;
+
+    auto loadStart = std::chrono::steady_clock::now();
+
+    try
+    {
+        mapManager.loadMap(selectedMapPath, tileWidth, tileHeight);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    const double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+    // create car without texture
+
+    const Vector2 startPos = {mapManager.tileMap()->width() * tileWidth * 0.5f, mapManager.tileMap()->height() * tileHeight * 0.5f};
+
+    Car car = carSettings.makeCar(startPos);
+
+    // run simulation, drift messages are muted so the timing only measures physics
+
+    const std::vector<ScriptStep> script = defaultScript();
+    size_t step = 0;
+    float stepTime = 0.f;
+
+    std::cout.setstate(std::ios::failbit);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (long long tick = 0; tick < ticks; ++tick)
+    {
+        if (stepTime >= script[step].duration)
+        {
+            stepTime = 0.f;
+            step = (step + 1) % script.size();
+        }
+        stepTime += dt;
+
+        car.applyInput(script[step].input, dt);
+        car.update(dt, &mapManager);
+        car.resolveCollision(*mapManager.collisionMap());
+        car.bakeTrails(&mapManager);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout.clear();
+
+    // report
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << "map: " << selectedMapPath << " (" << mapManager.tileMap()->width() << "x" << mapManager.tileMap()->height() 
+              << ", loaded in " << std::fixed << std::setprecision(2) << loadSeconds * 1000.0 << " ms)" << std::defaultfloat << std::setprecision(6) << std::endl;
+    std::cout << "ticks: " << ticks << " at " << tickRate << " Hz (" << ticks * dt << " s simulated)" << std::endl;
+    std::cout << "wall time: " << std::fixed << std::setprecision(3) << seconds << " s" << std::endl;
+    std::cout << "ticks per second: " << std::setprecision(0) << ticks / seconds << std::endl;
+    std::cout << std::setprecision(3);
+    std::cout << "final position: " << car.getPos().x << " " << car.getPos().y << std::endl;
+    std::cout << "final velocity: " << car.getVel().x << " " << car.getVel().y << std::endl;
+    std::cout << "final rotation: " << car.getRotation() << std::endl;
+    std::cout << "skid marks: " << car.getTrails().marks() << " in " << car.getTrails().pieces() << " strip pieces" << std::endl;
+    std::cout << "decal chunks: " << mapManager.decalMap()->chunkCount() << " (" << mapManager.decalMap()->memoryUsage() / 1024 << " KiB)" << std::endl;
+
+    return 0;
+}
+
+// compare cars per second of a loop over Car objects against one CarSystem
+
+int runCarBenchmark(int argc, char** argv)
+{
+    size_t carCount = 10000;
+    long long ticks = 1000;
+    float tickRate = 120.f;
+
+    try
+    {
+        if (argc > 2) carCount = std::stoul(argv[2]);
+        if (argc > 3) ticks = std::stoll(argv[3]);
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " bench-cars [carCount] [ticks]" << std::endl;
+        return 1;
+    }
+
+    if (carCount == 0 || ticks <= 0)
+    {
+        std::cerr << "bench-cars: carCount and ticks must be positive!" << std::endl;
+        return 1;
+    }
+
+    const float dt = 1.f / tickRate;
+    const std::vector<ScriptStep> script = defaultScript();
+
+    // every car starts the script at another time, so they dont all drive the same
+
+    std::vector<float> scriptOffset(carCount);
+    for (size_t i = 0; i < carCount; ++i) scriptOffset[i] = (float)(i % 97) * 0.1f;
+
+    // Car objects keep only a few trails, otherwise 10k cars would need gigabytes of trails
+
+    const size_t benchTrails = 64;
+
+    const CarSettings benchSettings = fewTrails(benchTrails);
+
+    std::vector<Car> cars;
+    cars.reserve(carCount);
+    for (size_t i = 0; i < carCount; ++i) cars.push_back(benchSettings.makeCar({0.f, 0.f}));
+
+    CarSystem carSystem(carParams());
+    carSystem.reserve(carCount);
+    for (size_t i = 0; i < carCount; ++i) carSystem.addCar({0.f, 0.f});
+
+    Map::MapManager mapManager;
+    mapManager.createMap(tileWidth, tileHeight, 1, 1);
+
+    std::cout.setstate(std::ios::failbit);
+
+    auto carStart = std::chrono::steady_clock::now();
+
+    for (long long tick = 0; tick < ticks; ++tick)
+    {
+        const float time = tick * dt;
+        for (size_t i = 0; i < carCount; ++i)
+        {
+            cars[i].applyInput(scriptInput(script, time + scriptOffset[i]), dt);
+            cars[i].update(dt, &mapManager);
+        }
+    }
+
+    auto carEnd = std::chrono::steady_clock::now();
+
+    for (long long tick = 0; tick < ticks; ++tick)
+    {
+        const float time = tick * dt;
+        for (size_t i = 0; i < carCount; ++i)
+        {
+            carSystem.applyInput(i, scriptInput(script, time + scriptOffset[i]), dt);
+        }
+        carSystem.update(dt);
+    }
+
+    auto systemEnd = std::chrono::steady_clock::now();
+
+    CarSystem batchedSystem(carParams());
+    batchedSystem.reserve(carCount);
+    for (size_t i = 0; i < carCount; ++i) batchedSystem.addCar({0.f, 0.f});
+
+    auto batchedStart = std::chrono::steady_clock::now();
+
+    for (long long tick = 0; tick < ticks; ++tick)
+    {
+        const float time = tick * dt;
+        for (size_t i = 0; i < carCount; ++i)
+        {
+            batchedSystem.applyInput(i, scriptInput(script, time + scriptOffset[i]), dt);
+        }
+        batchedSystem.updateBatched(dt);
+    }
+
+    auto batchedEnd = std::chrono::steady_clock::now();
+
+    std::cout.clear();
+
+    // both must end in the same state, the model is the same
+
+    float maxDiff = 0.f;
+    float batchedDiff = 0.f;
+    for (size_t i = 0; i < carCount; ++i)
+    {
+        maxDiff = fmaxf(maxDiff, Vector2Distance(cars[i].getPos(), carSystem.getPos(i)));
+        batchedDiff = fmaxf(batchedDiff, Vector2Distance(carSystem.getPos(i), batchedSystem.getPos(i)));
+    }
+
+    const double carSeconds = std::chrono::duration<double>(carEnd - carStart).count();
+    const double systemSeconds = std::chrono::duration<double>(systemEnd - carEnd).count();
+    const double batchedSeconds = std::chrono::duration<double>(batchedEnd - batchedStart).count();
+    const double carUpdates = (double)carCount * ticks;
+
+    std::cout << "cars: " << carCount << ", ticks: " << ticks << std::endl;
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "Car objects: " << carUpdates / carSeconds << " cars/s" << std::endl;
+    std::cout << "CarSystem:   " << carUpdates / systemSeconds << " cars/s" << std::endl;
+    std::cout << "CarSystem batched (" << Kernels::instructionSet() << "): " << carUpdates / batchedSeconds << " cars/s" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "speedup: " << carSeconds / systemSeconds << "x, batched " << carSeconds / batchedSeconds << "x" << std::endl;
+    std::cout << std::setprecision(6);
+    std::cout << "max position difference: " << maxDiff << ", batched " << batchedDiff << std::endl;
+
+    return 0;
+}
+
+// check the SIMD kernels: bit identical to their scalar path, within tolerance of libm and Car::getCarAABB
+
+int runKernelCheck(int argc, char** argv)
+{
+    size_t count = 1000003;
+
+    try
+    {
+        if (argc > 2) count = std::stoul(argv[2]);
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " check-kernels [count]" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> angle(-360.f, 360.f);
+    std::uniform_real_distribution<float> decay(-200.f, 0.f);
+    std::uniform_real_distribution<float> speed(-2000.f, 2000.f);
+
+    std::vector<float> deg(count), x(count), velX(count), velY(count), posX(count), posY(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        deg[i] = angle(rng);
+        x[i] = decay(rng);
+        velX[i] = speed(rng);
+        velY[i] = speed(rng);
+        posX[i] = speed(rng) * 10.f;
+        posY[i] = speed(rng) * 10.f;
+    }
+
+    std::vector<float> sinOut(count), cosOut(count), sinRef(count), cosRef(count);
+    std::vector<float> expOut(count), expRef(count);
+
+    Kernels::sinCosDeg(deg.data(), sinOut.data(), cosOut.data(), count);
+    Kernels::sinCosDegRange<Kernels::ScalarOps>(deg.data(), sinRef.data(), cosRef.data(), 0, count);
+    Kernels::exp(x.data(), expOut.data(), count);
+    Kernels::expRange<Kernels::ScalarOps>(x.data(), expRef.data(), 0, count);
+
+    std::vector<float> forwardY(count);
+    for (size_t i = 0; i < count; ++i) forwardY[i] = -cosOut[i];
+
+    std::vector<float> forwardSpeed(count), sidewaysSpeed(count);
+    Kernels::project(velX.data(), velY.data(), sinOut.data(), forwardY.data(), forwardSpeed.data(), sidewaysSpeed.data(), count);
+
+    std::vector<float> minX(count), minY(count), maxX(count), maxY(count);
+    Kernels::aabb(posX.data(), posY.data(), sinOut.data(), forwardY.data(), size.x, size.y, 0.8f * size.y,
+                  minX.data(), minY.data(), maxX.data(), maxY.data(), count);
+
+    size_t mismatches = 0;
+    float sinError = 0.f;
+    float expError = 0.f;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        // SIMD against its own scalar path, must be exact
+
+        if (sinOut[i] != sinRef[i] || cosOut[i] != cosRef[i] || expOut[i] != expRef[i]) ++mismatches;
+
+        // against libm, like Car::update
+
+        float rad = deg[i] * (PI / 180.f);
+        sinError = fmaxf(sinError, fabsf(sinOut[i] - sinf(rad)));
+        sinError = fmaxf(sinError, fabsf(cosOut[i] - cosf(rad)));
+        expError = fmaxf(expError, fabsf(expOut[i] - expf(x[i])) / fmaxf(expf(x[i]), 1e-30f));
+
+        // projection and AABB with the same directions must match the scalar formulas exactly
+
+        Vector2 forward = {sinOut[i], forwardY[i]};
+        Vector2 sideways = {-forward.y, forward.x};
+
+        if (forwardSpeed[i] != velX[i] * forward.x + velY[i] * forward.y) ++mismatches;
+        if (sidewaysSpeed[i] != velX[i] * sideways.x + velY[i] * sideways.y) ++mismatches;
+
+        const Vector2 offset = {0.5f * size.x, 0.8f * size.y};
+        const Vector2 fwdP = Vector2Scale(forward,  offset.y);
+        const Vector2 bwdP = Vector2Scale(forward,  offset.y - size.y);
+        const Vector2 rgtP = Vector2Scale(sideways,  size.x * 0.5f);
+        const Vector2 lftP = Vector2Scale(sideways, -size.x * 0.5f);
+
+        const Vector2 fwdRgt = Vector2Add(fwdP, rgtP);
+        const Vector2 fwdLft = Vector2Add(fwdP, lftP);
+        const Vector2 bwdRgt = Vector2Add(bwdP, rgtP);
+        const Vector2 bwdLft = Vector2Add(bwdP, lftP);
+
+        if (minX[i] != fminf(fminf(fwdRgt.x, fwdLft.x), fminf(bwdRgt.x, bwdLft.x)) + posX[i]) ++mismatches;
+        if (minY[i] != fminf(fminf(fwdRgt.y, fwdLft.y), fminf(bwdRgt.y, bwdLft.y)) + posY[i]) ++mismatches;
+        if (maxX[i] != fmaxf(fmaxf(fwdRgt.x, fwdLft.x), fmaxf(bwdRgt.x, bwdLft.x)) + posX[i]) ++mismatches;
+        if (maxY[i] != fmaxf(fmaxf(fwdRgt.y, fwdLft.y), fmaxf(bwdRgt.y, bwdLft.y)) + posY[i]) ++mismatches;
+    }
+
+    const bool ok = mismatches == 0 && sinError <= Kernels::sinDegTolerance && expError <= Kernels::expTolerance;
+
+    std::cout << "instruction set: " << Kernels::instructionSet() << ", values: " << count << std::endl;
+    std::cout << "mismatches against scalar path: " << mismatches << std::endl;
+    std::cout << std::scientific << std::setprecision(3);
+    std::cout << "sin/cos max abs error: " << sinError << " (tolerance " << Kernels::sinDegTolerance << ")" << std::endl;
+    std::cout << "exp max rel error: " << expError << " (tolerance " << Kernels::expTolerance << ")" << std::endl;
+    std::cout << (ok ? "OK" : "FAILED") << std::endl;
+
+    return ok ? 0 : 1;
+}
+
+// convert a map between the text and binary format
+
+int runConvert(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "usage: " << argv[0] << " convert <from> <to>" << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    try
+    {
+        Map::MapManager::convertMap(argv[2], argv[3], tileWidth, tileHeight);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "converted " << argv[2] << " to " << argv[3] << " in " << std::fixed << std::setprecision(2) << seconds * 1000.0 << " ms" << std::endl;
+
+    return 0;
+}
+
+// oval track around the world center, road band with a wall of one tile on both sides
+
+struct OvalTrack
+{
+    double centerX, centerY;
+    double radiusX, radiusY;
+    double halfWidth;
+
+    OvalTrack(int64_t width, int64_t height)
+        : centerX(width * 0.5), centerY(height * 0.5)
+        , radiusX(width * 0.4), radiusY(height * 0.4)
+        , halfWidth(6.0)
+    {}
+
+    // approximate distance to the center line in tiles
+
+    double distance(double x, double y) const
+    {
+        const double dx = (x - centerX) / radiusX;
+        const double dy = (y - centerY) / radiusY;
+        return fabs(sqrt(dx * dx + dy * dy) - 1.0) * std::min(radiusX, radiusY);
+    }
+
+    Vector2 worldPos(double angle) const
+    {
+        return {(float)((centerX + cos(angle) * radiusX) * tileWidth), (float)((centerY + sin(angle) * radiusY) * tileHeight)};
+    }
+};
+
+int runMakeWorld(int argc, char** argv)
+{
+    uint32_t width, height;
+
+    try
+    {
+        if (argc < 5) throw std::invalid_argument("missing arguments");
+        width = (uint32_t)std::stoul(argv[3]);
+        height = (uint32_t)std::stoul(argv[4]);
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " make-world <path> <width> <height>" << std::endl;
+        return 1;
+    }
+
+    const OvalTrack track(width, height);
+
+    auto start = std::chrono::steady_clock::now();
+
+    try
+    {
+        Map::writeWorld(argv[2], width, height, 64, [&](uint32_t x, uint32_t y, Map::TileType& type, bool& collision)
+        {
+            const double distance = track.distance(x + 0.5, y + 0.5);
+            if (distance < track.halfWidth) type = Map::TileType::ROAD;
+            else if (distance < track.halfWidth + 1.0) collision = true;
+        });
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "wrote " << argv[2] << " (" << width << "x" << height << ") in " << std::fixed << std::setprecision(2) << seconds << " s" << std::endl;
+
+    return 0;
+}
+
+// ai cars drive around the track of a world made with make-world, colliding with the streamed chunks
+// only the chunks around the cars are resident, counts the car cells that were not streamed in yet
+
+int runStream(int argc, char** argv)
+{
+    std::string worldPath;
+    long long ticks = 20000;
+    int carCount = 3;
+
+    try
+    {
+        if (argc < 3) throw std::invalid_argument("missing world");
+        worldPath = argv[2];
+        if (argc > 3) ticks = std::stoll(argv[3]);
+        if (argc > 4) carCount = std::stoi(argv[4]);
+        if (carCount < 1) throw std::invalid_argument("no cars");
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " stream <world> [ticks] [cars]" << std::endl;
+        return 1;
+    }
+
+    const float dt = 1.f / 120.f;
+    const float radius = 2048.f;
+
+    std::unique_ptr<Map::ChunkedWorld> world;
+
+    try
+    {
+        world = std::make_unique<Map::ChunkedWorld>(worldPath, tileWidth, tileHeight);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    const OvalTrack track(world->width(), world->height());
+
+    // a waypoint every 4 tiles along the center line
+
+    const double lapTiles = 2.0 * PI * sqrt((track.radiusX * track.radiusX + track.radiusY * track.radiusY) * 0.5);
+    const int waypointCount = std::max(64, (int)(lapTiles / 4.0));
+
+    std::vector<Vector2> waypoints;
+    for (int i = 0; i < waypointCount; ++i) waypoints.push_back(track.worldPos(2.0 * PI * i / waypointCount));
+
+    const CarSettings streamSettings = fewTrails(64);
+
+    std::vector<Car> cars;
+    std::vector<AIDriver> drivers;
+    std::vector<Vector2> focusPoints (carCount);
+
+    for (int i = 0; i < carCount; ++i)
+    {
+        const Vector2 pos = track.worldPos(-2.0 * PI * 2.0 * i / waypointCount);
+
+        cars.push_back(streamSettings.makeCar(pos));
+        cars.back().setLogDrifts(false);
+        drivers.emplace_back(waypoints, pos);
+        focusPoints[i] = pos;
+    }
+
+    // the cars start on loaded chunks, from then on the worker streams ahead of them
+
+    world->loadAround(focusPoints, radius);
+
+    size_t maxResident = 0;
+    long long contacts = 0;
+    long long misses = 0;
+    double driven = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (long long tick = 0; tick < ticks; ++tick)
+    {
+        for (int i = 0; i < carCount; ++i) focusPoints[i] = cars[i].getPos();
+
+        world->updateResidency(focusPoints, radius);
+        maxResident = std::max(maxResident, world->residentChunks());
+
+        for (int i = 0; i < carCount; ++i)
+        {
+            Car& car = cars[i];
+            car.applyInput(drivers[i].decide(car.getPos(), car.getRotation(), car.getVel(), *world), dt);
+            car.update(dt, nullptr);
+            contacts += car.resolveCollision(*world);
+
+            driven += Vector2Length(car.getVel()) * dt;
+            if (!world->isResident(world->getIndexWorldPos(car.getPos()))) ++misses;
+        }
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t passed = 0;
+    for (const AIDriver& driver : drivers) passed += driver.passed();
+
+    std::cout << "world: " << worldPath << " (" << world->width() << "x" << world->height() << ")" << std::endl;
+    std::cout << "ticks: " << ticks << ", cars: " << carCount << ", driven per car: " << std::fixed << std::setprecision(1) 
+              << driven / carCount / tileWidth << " tiles (" << driven / carCount / tileWidth / lapTiles << " laps)" << std::endl;
+    std::cout << "wall time: " << std::setprecision(3) << seconds << " s" << std::endl;
+    std::cout << "resident chunks: " << world->residentChunks() << " (max " << maxResident << ", " << world->residentBytes() / 1024 << " KiB)" << std::endl;
+    std::cout << "chunks read: " << world->chunksRead() << std::endl;
+    std::cout << "waypoints passed: " << passed << ", wall contacts: " << contacts << ", car cells not resident yet: " << misses << std::endl;
+
+    return 0;
+}
+
+// cars on an oval track with walls, time of the collision response alone
+
+int runCollisionBenchmark(int argc, char** argv)
+{
+    size_t carCount = 10000;
+    long long ticks = 1000;
+    bool distanceField = false;
+
+    try
+    {
+        if (argc > 2) carCount = std::stoul(argv[2]);
+        if (argc > 3) ticks = std::stoll(argv[3]);
+        if (argc > 4) distanceField = std::stoi(argv[4]) != 0;
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " bench-collision [carCount] [ticks] [distanceField 0/1]" << std::endl;
+        return 1;
+    }
+
+    const float dt = 1.f / 120.f;
+    const int mapSize = 256;
+
+    // walls on both sides of the track, the rest is open
+
+    Map::MapManager mapManager;
+    mapManager.createMap(tileWidth, tileHeight, mapSize, mapSize);
+
+    const OvalTrack track(mapSize, mapSize);
+    for (int i = 0; i < mapSize * mapSize; ++i)
+    {
+        const double distance = track.distance(i % mapSize + 0.5, i / mapSize + 0.5);
+        if (distance >= track.halfWidth && distance < track.halfWidth + 2.0) mapManager.collisionMap()->setCollision(i, true);
+    }
+
+    if (distanceField) mapManager.collisionMap()->enableDistanceField();
+
+    CarSystem carSystem(carParams());
+    carSystem.reserve(carCount);
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<double> angle(0.0, 2.0 * PI);
+    for (size_t i = 0; i < carCount; ++i) carSystem.addCar(track.worldPos(angle(random)));
+
+    const std::vector<ScriptStep> script = defaultScript();
+
+    std::vector<float> scriptOffset(carCount);
+    for (size_t i = 0; i < carCount; ++i) scriptOffset[i] = (float)(i % 97) * 0.1f;
+
+    Collision::CarGrid grid(tileWidth, mapSize * tileWidth, mapSize * tileHeight);
+
+    size_t contacts = 0;
+    size_t carContacts = 0;
+    double resolveSeconds = 0.0;
+    double carSeconds = 0.0;
+
+    for (long long tick = 0; tick < ticks; ++tick)
+    {
+        const float time = tick * dt;
+        for (size_t i = 0; i < carCount; ++i) carSystem.applyInput(i, scriptInput(script, time + scriptOffset[i]), dt);
+        carSystem.updateBatched(dt);
+
+        auto start = std::chrono::steady_clock::now();
+        contacts += carSystem.resolveCollisions(*mapManager.collisionMap(), dt);
+        resolveSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        carContacts += carSystem.resolveCarCollisions(grid);
+        carSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // cars whose center ended up in a wall
+
+    size_t inWalls = 0;
+    for (size_t i = 0; i < carCount; ++i)
+    {
+        if (mapManager.collisionMap()->isSolid(mapManager.collisionMap()->getIndexWorldPos(carSystem.getPos(i)))) ++inWalls;
+    }
+
+    std::cout << "cars: " << carCount << ", ticks: " << ticks << ", map: " << mapSize << "x" << mapSize 
+              << (distanceField ? ", with distance field" : "") << std::endl;
+    std::cout << "resolve: " << std::fixed << std::setprecision(3) << resolveSeconds * 1000.0 / ticks << " ms/tick, "
+              << std::setprecision(0) << carCount * ticks / resolveSeconds << " cars/s" << std::endl;
+    std::cout << "car against car: " << std::setprecision(3) << carSeconds * 1000.0 / ticks << " ms/tick, " << carContacts << " contacts" << std::endl;
+    std::cout << "contacts: " << contacts << ", cars inside walls at the end: " << inWalls << std::endl;
+
+    return 0;
+}
+
+// cars at the same density for every count, grid broadphase against testing all pairs
+// only the tests are timed, the boxes dont move so every repetition does the same work
+
+int runBroadphaseBenchmark(int argc, char** argv)
+{
+    size_t maxCars = 100000;
+
+    try
+    {
+        if (argc > 2) maxCars = std::stoul(argv[2]);
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " bench-broadphase [maxCars]" << std::endl;
+        return 1;
+    }
+
+    const Vector2 offset = {0.5f * size.x, 0.8f * size.y};
+    const float areaPerCar = 4.f * tileWidth * tileHeight;
+    const size_t maxBruteForce = 5000;
+
+    std::mt19937 random(11);
+
+    std::cout << std::setw(8) << "cars" << std::setw(12) << "grid ms" << std::setw(12) << "tested" << std::setw(10) << "contacts"
+              << std::setw(14) << "pairs/s" << std::setw(12) << "all ms" << std::setw(14) << "pairs/s" << std::endl;
+
+    for (size_t carCount = 100; carCount <= maxCars; carCount *= 10)
+    {
+        const int worldSize = (int)sqrtf(carCount * areaPerCar);
+        std::uniform_real_distribution<float> position(0.f, (float)worldSize);
+        std::uniform_real_distribution<float> rotation(0.f, 360.f);
+
+        std::vector<Collision::OrientedBox> boxes(carCount);
+        for (auto& box : boxes) box = Collision::carBox({position(random), position(random)}, rotation(random), size, offset);
+
+        Collision::CarGrid grid(tileWidth, worldSize, worldSize);
+
+        const int repeats = (int)std::max<size_t>(1000000 / carCount, 1);
+        size_t contacts = 0;
+        size_t tested = 0;
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (int repeat = 0; repeat < repeats; ++repeat)
+        {
+            contacts = 0;
+            grid.rebuild(boxes);
+            grid.forEachPair([&](int i, int j)
+            {
+                Vector2 normal;
+                float depth;
+                if (Collision::boxVsBox(boxes[i], boxes[j], normal, depth)) ++contacts;
+            });
+            tested = grid.testedPairs();
+        }
+
+        const double gridSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+        std::cout << std::setw(8) << carCount << std::fixed << std::setprecision(3) << std::setw(12) << gridSeconds * 1000.0
+                  << std::setw(12) << tested << std::setw(10) << contacts << std::setprecision(0) << std::setw(14) << tested / gridSeconds;
+
+        // every pair, only for small counts
+
+        if (carCount <= maxBruteForce)
+        {
+            const int bruteRepeats = (int)std::max<size_t>(10000000 / (carCount * carCount), 1);
+            size_t bruteContacts = 0;
+
+            start = std::chrono::steady_clock::now();
+
+            for (int repeat = 0; repeat < bruteRepeats; ++repeat)
+            {
+                bruteContacts = 0;
+                for (size_t i = 0; i < carCount; ++i)
+                {
+                    for (size_t j = i + 1; j < carCount; ++j)
+                    {
+                        Vector2 normal;
+                        float depth;
+                        if (Collision::boxVsBox(boxes[i], boxes[j], normal, depth)) ++bruteContacts;
+                    }
+                }
+            }
+
+            const double bruteSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / bruteRepeats;
+            const double pairs = carCount * (carCount - 1) / 2.0;
+
+            std::cout << std::setprecision(3) << std::setw(12) << bruteSeconds * 1000.0 << std::setprecision(0) << std::setw(14) << pairs / bruteSeconds;
+            if (bruteContacts != contacts) std::cout << "  MISMATCH (" << bruteContacts << " contacts)";
+        }
+
+        std::cout << std::defaultfloat << std::endl;
+    }
+
+    return 0;
+}
+
+// ai cars driving laps on an oval track, the same race once on one thread and once on several
+// a tick is a graph of jobs over the stages of Race::tick, cars only share the car against car job,
+// so both races must end the same
+
+struct AIRace
+{
+    double seconds{0.0};
+    std::vector<JobSystem::JobTiming> jobTotals;
+    std::vector<JobSystem::JobId> criticalPath;
+    std::vector<Vector2> positions;
+    size_t passed{0};
+    size_t inWalls{0};
+};
+
+AIRace runAIRace(size_t carCount, long long ticks, size_t threads)
+{
+    const float dt = 1.f / 120.f;
+    const int mapSize = 256;
+
+    Map::MapManager mapManager;
+    mapManager.createMap(tileWidth, tileHeight, mapSize, mapSize);
+
+    const OvalTrack track(mapSize, mapSize);
+    for (int i = 0; i < mapSize * mapSize; ++i)
+    {
+        const double distance = track.distance(i % mapSize + 0.5, i / mapSize + 0.5);
+        if (distance >= track.halfWidth && distance < track.halfWidth + 2.0) mapManager.collisionMap()->setCollision(i, true);
+    }
+
+    const Map::CollisionMap& colMap = *mapManager.collisionMap();
+
+    std::vector<Vector2> waypoints;
+    for (int i = 0; i < 64; ++i) waypoints.push_back(track.worldPos(2.0 * PI * i / 64));
+
+    // start in a line along the track, facing along it (clockwise on screen)
+    // the player car is the first one, it is driven by an ai through its input source
+
+    std::vector<Vector2> startPositions;
+    for (size_t i = 0; i < carCount; ++i) startPositions.push_back(track.worldPos(2.0 * PI * i / carCount));
+
+    const CarSettings raceSettings = fewTrails(64);
+
+    Race race(&mapManager, tileWidth, tileHeight, startPositions, waypoints, [&](Vector2 pos)
+    {
+        return raceSettings.makeCar(pos);
+    });
+    race.player().setLogDrifts(false);
+
+    AIDriver playerDriver(waypoints, startPositions.front());
+    Car& player = race.player();
+
+    InputSource input([&]
+    {
+        return playerDriver.decide(player.getPos(), player.getRotation(), player.getVel(), colMap);
+    });
+
+    JobSystem jobs(threads);
+
+    const JobSystem::JobId driveJob = jobs.add("drive", [&]
+    {
+        race.drive(dt, &mapManager, &input, &jobs);
+    });
+
+    const JobSystem::JobId carCollisionJob = jobs.add("car collision", [&]
+    {
+        race.collideCars();
+    }, {driveJob});
+
+    jobs.add("trails", [&]
+    {
+        race.bakeTrails(&mapManager);
+    }, {carCollisionJob});
+
+    AIRace result;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (long long tick = 0; tick < ticks; ++tick)
+    {
+        jobs.run();
+
+        result.jobTotals.resize(jobs.timings().size());
+        for (size_t id = 0; id < jobs.timings().size(); ++id)
+        {
+            result.jobTotals[id].name = jobs.timings()[id].name;
+            result.jobTotals[id].end += jobs.timings()[id].end - jobs.timings()[id].start;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.criticalPath = jobs.criticalPath();
+
+    result.passed = playerDriver.passed();
+    for (const AIDriver& driver : race.drivers()) result.passed += driver.passed();
+
+    result.positions.push_back(player.getPos());
+    for (const Car& car : race.aiCars()) result.positions.push_back(car.getPos());
+
+    for (const Vector2& pos : result.positions)
+    {
+        if (colMap.isSolid(colMap.getIndexWorldPos(pos))) ++result.inWalls;
+    }
+
+    return result;
+}
+
+int runAIBenchmark(int argc, char** argv)
+{
+    size_t carCount = 256;
+    long long ticks = 2000;
+    size_t threads = 0;
+
+    try
+    {
+        if (argc > 2) carCount = std::stoul(argv[2]);
+        if (argc > 3) ticks = std::stoll(argv[3]);
+        if (argc > 4) threads = std::stoul(argv[4]);
+        if (carCount == 0) throw std::invalid_argument("no cars");
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " bench-ai [carCount] [ticks] [threads, 0 for every core]" << std::endl;
+        return 1;
+    }
+
+    const AIRace serial = runAIRace(carCount, ticks, 1);
+    const AIRace parallel = runAIRace(carCount, ticks, threads);
+
+    bool same = true;
+    for (size_t i = 0; i < carCount; ++i)
+    {
+        if (serial.positions[i].x != parallel.positions[i].x || serial.positions[i].y != parallel.positions[i].y) same = false;
+    }
+
+    const size_t poolThreads = threads == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : threads;
+
+    std::cout << "cars: " << carCount << ", ticks: " << ticks << std::endl;
+    std::cout << "1 thread:  " << std::fixed << std::setprecision(3) << serial.seconds * 1000.0 / ticks << " ms/tick" << std::endl;
+    std::cout << poolThreads << " threads: " << parallel.seconds * 1000.0 / ticks << " ms/tick, " 
+              << std::setprecision(2) << serial.seconds / parallel.seconds << "x" << std::endl;
+    std::cout << "waypoints passed per car: " << std::setprecision(1) << (double)parallel.passed / carCount 
+              << " of 64 per lap, cars inside walls: " << parallel.inWalls << std::endl;
+    std::cout << "same result on both: " << (same ? "yes" : "NO") << std::endl;
+
+    std::cout << "jobs, ms/tick on " << poolThreads << " threads (* critical path of the last tick):" << std::endl;
+    for (JobSystem::JobId id = 0; id < parallel.jobTotals.size(); ++id)
+    {
+        const bool critical = std::find(parallel.criticalPath.begin(), parallel.criticalPath.end(), id) != parallel.criticalPath.end();
+        std::cout << (critical ? "  * " : "    ") << std::left << std::setw(16) << parallel.jobTotals[id].name << std::right 
+                  << std::setprecision(4) << parallel.jobTotals[id].end / ticks << std::endl;
+    }
+
+    return same ? 0 : 1;
+}
+
+// inputs of the default script, recorded like the game records the keyboard with --record
+
+int runMakeReplay(int argc, char** argv)
+{
+    std::string logPath;
+    long long ticks = 12000;
+    int aiCars = 3;
+    float tickRate = 120.f;
+
+    try
+    {
+        if (argc < 3) throw std::invalid_argument("missing arguments");
+        logPath = argv[2];
+        if (argc > 3) ticks = std::stoll(argv[3]);
+        if (argc > 4) aiCars = std::stoi(argv[4]);
+        if (argc > 5) tickRate = std::stof(argv[5]);
+        if (aiCars < 0 || aiCars > (int)InputLog::maxAiCars || !std::isfinite(tickRate) || tickRate <= 0.f) throw std::invalid_argument("out of range");
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " make-replay <log> [ticks] [aiCars] [tickRate]" << std::endl;
+        return 1;
+    }
+
+    const std::vector<ScriptStep> script = defaultScript();
+    const float dt = 1.f / tickRate;
+    long long tick = 0;
+
+    InputLog log(tickRate, (uint32_t)aiCars);
+    InputSource input([&] {return scriptInput(script, tick * dt);});
+    input.record(&log);
+
+    for (tick = 0; tick < ticks; ++tick) input.next();
+
+    try
+    {
+        log.save(logPath);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "recorded " << log.ticks() << " ticks in " << log.runs().size() << " runs to " << logPath << std::endl;
+
+    return 0;
+}
+
+// play a recorded session without window as fast as the cpu allows, same race and map as the game
+// the final state of the player is printed, so two runs (or two builds) can be compared
+
+int runReplay(int argc, char** argv)
+{
+    std::string logPath;
+    std::string mapPath = "data/map.txt";
+    size_t threads = 0;
+
+    try
+    {
+        if (argc < 3) throw std::invalid_argument("missing arguments");
+        logPath = argv[2];
+        if (argc > 3) mapPath = argv[3];
+        if (argc > 4) threads = std::stoul(argv[4]);
+    }
+    catch (const std::exception&)
+    {
+        std::cerr << "usage: " << argv[0] << " replay <log> [mapPath] [threads, 0 for every core]" << std::endl;
+        return 1;
+    }
+
+    InputLog log;
+    Map::MapManager mapManager;
+
+    try
+    {
+        log = InputLog::load(logPath);
+        mapManager.loadMap(mapPath, tileWidth, tileHeight);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    Race race(&mapManager, tileWidth, tileHeight, (int)log.aiCars(), [](Vector2 pos)
+    {
+        return carSettings.makeCar(pos);
+    });
+
+    InputSource input = InputSource::replay(log);
+    JobSystem jobs(threads);
+    SimStats stats;
+
+    const float dt = 1.f / log.tickRate();
+
+    // drift messages are muted so the timing only measures physics
+
+    std::cout.setstate(std::ios::failbit);
+
+    const auto start = std::chrono::steady_clock::now();
+    while (!input.finished()) race.tick(dt, &mapManager, &input, &jobs, &stats);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout.clear();
+
+    const Car& player = race.player();
+
+    std::cout << "replay: " << logPath << " on " << mapPath << ", " << log.aiCars() << " ai cars, " << log.tickRate() << " Hz, " 
+              << jobs.threadCount() << " threads" << std::endl;
+    stats.print(std::cout, seconds);
+    std::cout << std::setprecision(9) << "final position: " << player.getPos().x << " " << player.getPos().y << std::endl;
+    std::cout << "final velocity: " << player.getVel().x << " " << player.getVel().y << std::endl;
+    std::cout << "final rotation: " << player.getRotation() << std::defaultfloat << std::endl;
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+
+    if (mode == "bench-cars") return runCarBenchmark(argc, argv);
+    if (mode == "check-kernels") return runKernelCheck(argc, argv);
+    if (mode == "convert") return runConvert(argc, argv);
+    if (mode == "make-world") return runMakeWorld(argc, argv);
+    if (mode == "stream") return runStream(argc, argv);
+    if (mode == "bench-collision") return runCollisionBenchmark(argc, argv);
+    if (mode == "bench-broadphase") return runBroadphaseBenchmark(argc, argv);
+    if (mode == "bench-ai") return runAIBenchmark(argc, argv);
+    if (mode == "make-replay") return runMakeReplay(argc, argv);
+    if (mode == "replay") return runReplay(argc, argv);
+    return runSimulation(argc, argv);
+}